@@ -0,0 +1,112 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Blocks start small, so that arenas holding little stay cheap, and double in
+// size up to the maximum as the arena fills.
+static const size_t min_block_size = 1024;
+static const size_t max_block_size = 64 * 1024;
+
+arena::arena(arena &&other)
+  : blocks_(other.blocks_), cur_(other.cur_), end_(other.end_),
+    dtors_(other.dtors_) {
+  other.blocks_ = nullptr;
+  other.cur_ = other.end_ = nullptr;
+  other.dtors_ = nullptr;
+}
+
+arena::~arena() {
+  release();
+}
+
+arena& arena::operator=(arena &&other) {
+  if (this != &other) {
+    release();
+    blocks_ = other.blocks_; cur_ = other.cur_; end_ = other.end_;
+    dtors_ = other.dtors_;
+    other.blocks_ = nullptr;
+    other.cur_ = other.end_ = nullptr;
+    other.dtors_ = nullptr;
+  }
+  return *this;
+}
+
+char *arena::grow(size_t size, size_t align) {
+  size_t block_size = min_block_size;
+  if (blocks_)
+    block_size = std::min(blocks_->size * 2, max_block_size);
+
+  // Oversized requests get a block of their own so the tail of the current
+  // block isn't wasted.
+  size_t need = sizeof(block) + size + align;
+  size_t bytes = need > block_size ? need : block_size;
+  block *b = static_cast<block*>(std::malloc(bytes));
+  if (!b)
+    throw std::bad_alloc();
+  b->size = bytes;
+  b->next = blocks_;
+  blocks_ = b;
+
+  char *p = align_up(reinterpret_cast<char*>(b + 1), align);
+  if (need <= block_size) {
+    cur_ = p + size;
+    end_ = reinterpret_cast<char*>(b) + bytes;
+  }
+  return p;
+}
+
+void arena::add_dtor(void *obj, void (*fn)(void*)) {
+  dtor *d = static_cast<dtor*>(allocate(sizeof(dtor), alignof(dtor)));
+  d->next = dtors_;
+  d->fn = fn;
+  d->obj = obj;
+  dtors_ = d;
+}
+
+void arena::adopt(arena &&other) {
+  if (block *b = other.blocks_) {
+    // Splice the other arena's blocks in behind the current one, so we keep
+    // allocating from where we were.
+    while (b->next)
+      b = b->next;
+    if (blocks_) {
+      b->next = blocks_->next;
+      blocks_->next = other.blocks_;
+    } else {
+      b->next = nullptr;
+      blocks_ = other.blocks_;
+      cur_ = other.cur_;
+      end_ = other.end_;
+    }
+  }
+  if (dtor *d = other.dtors_) {
+    while (d->next)
+      d = d->next;
+    d->next = dtors_;
+    dtors_ = other.dtors_;
+  }
+  other.blocks_ = nullptr;
+  other.cur_ = other.end_ = nullptr;
+  other.dtors_ = nullptr;
+}
+
+size_t arena::get_reserved() const {
+  size_t size = 0;
+  for (block *b = blocks_; b; b = b->next)
+    size += b->size;
+  return size;
+}
+
+void arena::release() {
+  for (dtor *d = dtors_; d; d = d->next)
+    d->fn(d->obj);
+  dtors_ = nullptr;
+
+  while (blocks_) {
+    block *next = blocks_->next;
+    std::free(blocks_);
+    blocks_ = next;
+  }
+  cur_ = end_ = nullptr;
+}
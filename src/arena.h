@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// A bump-pointer allocator. Objects are carved out of large blocks and are all
+// released at once when the arena goes away; objects that need a destructor
+// run are remembered and destroyed, in reverse order, at that point.
+class arena {
+public:
+  arena() : blocks_(nullptr), cur_(nullptr), end_(nullptr), dtors_(nullptr) { }
+  arena(arena &&other);
+  ~arena();
+
+  arena& operator=(arena &&other);
+
+  void *allocate(size_t size, size_t align) {
+    char *p = align_up(cur_, align);
+    if (!cur_ || p + size > end_)
+      return grow(size, align);
+    cur_ = p + size;
+    return p;
+  }
+
+  template<typename T, typename... Args>
+  T *make(Args&&... args) {
+    T *t = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+      add_dtor(t, [](void *p) { static_cast<T*>(p)->~T(); });
+    return t;
+  }
+
+  // Allocates an uninitialized array of n trivial values.
+  template<typename T>
+  T *make_array(size_t n) {
+    static_assert(std::is_trivial<T>::value,
+                  "Only arrays of trivial values can be left uninitialized");
+    return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // Takes over everything allocated in the other arena, which is left empty.
+  // The objects stay where they are.
+  void adopt(arena &&other);
+
+  // The number of bytes reserved from the system so far.
+  size_t get_reserved() const;
+
+private:
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  struct block {
+    block *next;
+    size_t size;
+  };
+
+  struct dtor {
+    dtor *next;
+    void (*fn)(void*);
+    void *obj;
+  };
+
+  static char *align_up(char *p, size_t align) {
+    return reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t)(align - 1));
+  }
+
+  char *grow(size_t size, size_t align);
+  void add_dtor(void *obj, void (*fn)(void*));
+  void release();
+
+  block *blocks_;
+  char  *cur_, *end_;
+  dtor  *dtors_;
+};
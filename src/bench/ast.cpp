@@ -0,0 +1,172 @@
+// Walks every node of a large module's definitions, once through the tree of
+// constructs and once through a flat_ast, and reports nodes walked per
+// second. The flat walk is also timed with the flattening included, which is
+// what a single pass over a fresh module pays. Then builds a def_index over
+// the flat tree and a call_graph of the module, on one thread and on a pool,
+// and dumps the module in each of --dump-ast's formats and reports the
+// output's MB/s.
+
+#include "callgraph.h"
+#include "corpus.h"
+#include "defindex.h"
+#include "dump.h"
+#include "flat_ast.h"
+#include "module.h"
+#include "parser.h"
+#include "stream.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+
+// Keeps results the walks compute from being optimized away.
+static volatile size_t sink;
+
+static size_t walk_symbol(const construct_symbol *c, size_t &sum) {
+  sum += c->get_sym().get_id();
+  return 1;
+}
+
+template<typename T>
+static size_t walk_vec(const construct_vec<T> *c, size_t &sum) {
+  size_t n = 1;
+  for (const T *child : c->get_list()) {
+    if constexpr (std::is_base_of<construct_symbol, T>::value)
+      n += walk_symbol(child, sum);
+    else
+      n += walk_vec(child, sum);
+  }
+  return n;
+}
+
+static size_t walk_tree(const module &mod) {
+  size_t n = 0, sum = 0;
+  for (const construct_def *def : mod.get_defs()) {
+    n += 2 + walk_symbol(def->get_name(), sum);
+    n += walk_vec(def->get_type()->get_inp(), sum);
+    n += walk_vec(def->get_type()->get_out(), sum);
+    n += walk_vec(def->get_args(), sum);
+    n += walk_vec(def->get_body(), sum);
+  }
+  sink = sum;
+  return n;
+}
+
+// Every node is visited once, in order, so a pass over the arrays is a walk
+// of the whole tree.
+static size_t walk_flat(const flat_ast &ast) {
+  size_t sum = 0;
+  for (uint32_t i = 0, e = ast.get_num_nodes(); i != e; ++i)
+    sum += ast.get_size(i) ? ast.get_size(i) : ast.get_sym(i).get_id();
+  sink = sum;
+  return ast.get_num_nodes();
+}
+
+static void bench(const char *name, const std::function<size_t()> &fn) {
+  const unsigned runs = 5;
+  double best = 0;
+  size_t nodes = 0;
+  for (unsigned i = 0; i != runs; ++i) {
+    auto begin = std::chrono::steady_clock::now();
+    nodes = fn();
+    std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - begin;
+    if (i == 0 || secs.count() < best)
+      best = secs.count();
+  }
+  std::printf("%-14s %10zu nodes %14.0f nodes/s\n", name, nodes,
+              nodes / best);
+}
+
+// Counts what's written to it and throws it away.
+class counting_buf : public std::streambuf {
+public:
+  counting_buf() : count(0) { }
+
+  size_t count;
+
+protected:
+  std::streamsize xsputn(const char *, std::streamsize n) {
+    count += n;
+    return n;
+  }
+
+  int overflow(int c) {
+    ++count;
+    return c;
+  }
+};
+
+static void bench_dump(const char *name, ast_dumper::format fmt,
+                       const module &mod, const stream &s) {
+  const unsigned runs = 5;
+  double best = 0;
+  size_t bytes = 0;
+  for (unsigned i = 0; i != runs; ++i) {
+    counting_buf buf;
+    std::ostream os(&buf);
+    auto begin = std::chrono::steady_clock::now();
+    ast_dumper dumper(fmt, os);
+    if (!dumper.dump(mod, s)) {
+      std::fprintf(stderr, "%s: failed to dump\n", name);
+      std::exit(1);
+    }
+    std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - begin;
+    bytes = buf.count;
+    if (i == 0 || secs.count() < best)
+      best = secs.count();
+  }
+  std::printf("%-14s %10zu bytes %14.1f MB/s\n", name, bytes,
+              bytes / best / 1e6);
+}
+
+int main() {
+  corpus_options opts;
+  opts.defs = 200000;
+  std::string text = make_corpus(opts);
+  stream s("ast", text);
+  parser prs(s);
+  module mod = prs.parse();
+  if (!mod.is_valid()) {
+    std::fprintf(stderr, "failed to parse the corpus\n");
+    return 1;
+  }
+
+  flat_ast ast(mod);
+  if (walk_tree(mod) != ast.get_num_nodes()) {
+    std::fprintf(stderr, "the trees have different numbers of nodes\n");
+    return 1;
+  }
+  bench("tree", [&] { return walk_tree(mod); });
+  bench("flat", [&] { return walk_flat(ast); });
+  bench("flatten+flat", [&] {
+    flat_ast fresh(mod);
+    return walk_flat(fresh);
+  });
+  bench("def_index", [&] {
+    def_index index(ast);
+    sink = index.get_undefined().size();
+    return ast.get_num_nodes();
+  });
+  thread_pool pool;
+  bench("graph", [&] {
+    call_graph graph(mod);
+    sink = graph.get_order().front();
+    return ast.get_num_nodes();
+  });
+  bench("graph.pool", [&] {
+    call_graph graph(mod, pool);
+    sink = graph.get_order().front();
+    return ast.get_num_nodes();
+  });
+  bench_dump("dump.json", ast_dumper::format::JSON, mod, s);
+  bench_dump("dump.bin", ast_dumper::format::BIN, mod, s);
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Compares the static combinators in combinator.h with the same grammar built
+// from type-erased std::function rules, which is how the combinators used to
+// be implemented.
+
+#include "combinator.h"
+#include "parser.h"
+#include "scanner.h"
+#include "stream.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+typedef std::function<construct*(parser&)> erased_ty;
+
+template<typename T>
+static erased_ty erase(T run) {
+  return erased_ty(run);
+}
+
+static construct *parse_run(parser &prs, const scanner &scn) {
+  stream &s = prs.get_stream();
+  const char *begin = s.get_ptr();
+  s.skip_to(scn.scan(begin, s.get_end()));
+  if (s.get_ptr() == begin) {
+    prs.add_error(parser::class_token(scn));
+    prs.set_valid(false);
+  }
+  return nullptr;
+}
+
+static constexpr auto spaces = [](parser &prs) -> construct* {
+  return parse_run(prs, scanner::is_space);
+};
+
+static constexpr auto maybe_spaces = [](parser &prs) -> construct* {
+  stream &s = prs.get_stream();
+  s.skip_to(scanner::is_space.scan(s.get_ptr(), s.get_end()));
+  return nullptr;
+};
+
+static constexpr auto ident = [](parser &prs) -> construct* {
+  return parse_run(prs, scanner::is_ident);
+};
+
+template<typename T, typename U>
+static parser &comma_sep(parser &prs, T run, U next) {
+  if (prs >> run)
+    while (do_try(prs, compose(maybe_spaces, parse_char<','>)))
+      if (!do_try(prs, next))
+        break;
+  return prs;
+}
+
+template<typename T, typename U>
+static parser &space_sep(parser &prs, T run, U next) {
+  if (prs >> run)
+    while (do_try(prs, next));
+  return prs;
+}
+
+// The type signature grammar, "(a b, c -> d e)", written with static rules.
+static constexpr auto static_compound = [](parser &prs) -> construct* {
+  space_sep(prs, ident, compose(spaces, ident));
+  return nullptr;
+};
+
+static constexpr auto static_list = [](parser &prs) -> construct* {
+  comma_sep(prs, static_compound, compose(maybe_spaces, static_compound));
+  return nullptr;
+};
+
+static constexpr auto static_sig =
+  compose(parse_char<'('>, maybe_spaces, static_list, maybe_spaces,
+          parse_string<'-', '>'>, maybe_spaces, maybe(static_compound),
+          maybe_spaces, parse_char<')'>, maybe_spaces);
+
+// The same grammar, with every rule and combinator type-erased.
+static erased_ty make_erased_sig() {
+  erased_ty e_ident = erase(ident), e_spaces = erase(spaces),
+            e_maybe_spaces = erase(maybe_spaces);
+  erased_ty e_next_ident = erase(compose(e_spaces, e_ident));
+  erased_ty compound = [=](parser &prs) -> construct* {
+    space_sep(prs, e_ident, e_next_ident);
+    return nullptr;
+  };
+  erased_ty next_compound = erase(compose(e_maybe_spaces, compound));
+  erased_ty list = [=](parser &prs) -> construct* {
+    comma_sep(prs, compound, next_compound);
+    return nullptr;
+  };
+  return erase(compose(erase(parse_char<'('>), e_maybe_spaces, list,
+                       e_maybe_spaces, erase(parse_string<'-', '>'>),
+                       e_maybe_spaces, erase(maybe(compound)),
+                       e_maybe_spaces, erase(parse_char<')'>),
+                       e_maybe_spaces));
+}
+
+template<typename T>
+static double run(const char *name, const std::string &text, unsigned sigs,
+                  unsigned reps, T sig) {
+  parser prs(stream(name, text));
+  stream::location start = prs.get_stream().get_loc();
+  auto begin = std::chrono::steady_clock::now();
+  unsigned parsed = 0;
+  for (unsigned r = 0; r != reps; ++r) {
+    prs.get_stream().set_loc(start);
+    for (; prs.get_stream().peek(); ++parsed) {
+      prs.reset();
+      if (!(prs >> sig))
+        break;
+    }
+  }
+  std::chrono::duration<double> secs =
+    std::chrono::steady_clock::now() - begin;
+  if (parsed != sigs * reps)
+    std::fprintf(stderr, "%s: parsed %u of %u signatures\n", name, parsed,
+                 sigs * reps);
+  double rate = parsed / secs.count();
+  std::printf("%-8s %10.0f signatures/s\n", name, rate);
+  return rate;
+}
+
+int main() {
+  const unsigned sigs = 10000, reps = 20;
+  std::string text;
+  for (unsigned i = 0; i != sigs; ++i)
+    text += i % 2 ? "(a b c -> b c a)\n" : "(stack a, stack  b -> stack a b) ";
+
+  double erased = run("erased", text, sigs, reps, make_erased_sig());
+  double fixed = run("static", text, sigs, reps, static_sig);
+  std::printf("speedup  %10.2fx\n", fixed / erased);
+  return 0;
+}
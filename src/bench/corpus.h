@@ -0,0 +1,99 @@
+#pragma once
+
+// Generates synthetic wildcat sources for the benchmarks. The same options
+// always produce the same text, on any platform, so results from different
+// builds are comparable.
+
+#include <cstdint>
+#include <string>
+
+struct corpus_options {
+  corpus_options()
+    : defs(20000), width(3), body(8), error_rate(0), seed(1) {
+  }
+
+  // The number of definitions.
+  unsigned defs;
+  // The number of names in each definition's input and output types.
+  unsigned width;
+  // The number of words in each definition's body.
+  unsigned body;
+  // The fraction of definitions that get a syntax error.
+  double   error_rate;
+  uint64_t seed;
+};
+
+// SplitMix64, which is tiny and has no platform-dependent behavior, unlike
+// the standard distributions.
+class corpus_rng {
+public:
+  explicit corpus_rng(uint64_t seed) : state_(seed) { }
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // A number in [0, n).
+  unsigned below(unsigned n) { return next() % n; }
+  // A number in [0, 1).
+  double   unit()            { return (next() >> 11) * 0x1.0p-53; }
+
+private:
+  uint64_t state_;
+};
+
+// Returns a source of definitions like
+//
+//   w12 : (t0 t1 t2, t3 -> t3 t2 t1 t0) (t0 t1 t2 t3) -> t2 w3 swap t0 ;
+//
+// where every other definition takes arguments and bodies call primitives,
+// their arguments and earlier definitions. A definition with an error is
+// missing the arrow before its body, is missing its ':', has a malformed
+// arrow in its type or is missing the type's ')', in equal proportions.
+inline std::string make_corpus(const corpus_options &opts) {
+  static const char *const prims[] = { "dup", "drop", "swap", "rot", "over" };
+  corpus_rng rng(opts.seed);
+  std::string text, name;
+  for (unsigned i = 0; i != opts.defs; ++i) {
+    unsigned error = rng.unit() < opts.error_rate ? 1 + rng.below(4) : 0;
+    bool args = i % 2 == 0 && opts.width;
+
+    name = "w" + std::to_string(i);
+    text += name;
+    text += error == 2 ? " = (" : " : (";
+    for (unsigned j = 0; j != opts.width; ++j) {
+      if (j)
+        text += j % 3 ? " " : ", ";
+      text += "t" + std::to_string(j);
+    }
+    text += error == 3 ? " => " : " -> ";
+    for (unsigned j = opts.width; j--;)
+      text += "t" + std::to_string(j) + (j ? " " : "");
+    if (error != 4)
+      text += ")";
+    if (args) {
+      text += " (";
+      for (unsigned j = 0; j != opts.width; ++j)
+        text += (j ? " t" : "t") + std::to_string(j);
+      text += ")";
+    }
+
+    if (error != 1)
+      text += " ->";
+    for (unsigned j = 0; j != opts.body; ++j) {
+      text += " ";
+      unsigned pick = rng.below(3);
+      if (pick == 0 && args)
+        text += "t" + std::to_string(rng.below(opts.width));
+      else if (pick == 1 && i)
+        text += "w" + std::to_string(rng.below(i));
+      else
+        text += prims[rng.below(5)];
+    }
+    text += " ;\n";
+  }
+  return text;
+}
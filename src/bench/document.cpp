@@ -0,0 +1,59 @@
+// Times what an editor's keystroke costs the server: a one-character edit to
+// a document, then getting its diagnostics to publish, on documents of 20k
+// and 200k definitions, without errors and with about 200 of them. Per-edit
+// times should stay flat as the document grows; only the diagnostics add to
+// them, by how many of them there are.
+
+#include "corpus.h"
+#include "document.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Keeps results the benchmarks compute from being optimized away.
+static volatile size_t sink;
+
+static void bench(unsigned defs, unsigned errors) {
+  corpus_options opts;
+  opts.defs = defs;
+  opts.error_rate = double(errors) / defs;
+  std::string text = make_corpus(opts);
+
+  auto begin = std::chrono::steady_clock::now();
+  document doc("bench", text);
+  std::chrono::duration<double> open =
+    std::chrono::steady_clock::now() - begin;
+
+  // Type a character at the start of lines all over the document, and take
+  // it out again, keeping the median of the typing.
+  const unsigned edits = 200;
+  std::vector<double> secs;
+  std::vector<document::diagnostic> diags;
+  for (unsigned i = 0; i != edits; ++i) {
+    unsigned line = 1 + uint64_t(i) * 7919 % defs;
+    document::position pos(line, 1), next(line, 2);
+    begin = std::chrono::steady_clock::now();
+    doc.edit(pos, pos, "x");
+    diags.clear();
+    doc.get_diagnostics(diags);
+    std::chrono::duration<double> edit =
+      std::chrono::steady_clock::now() - begin;
+    secs.push_back(edit.count());
+    doc.edit(pos, next, "");
+  }
+  sink = diags.size();
+  std::sort(secs.begin(), secs.end());
+
+  std::printf("%7u defs %8.1f ms open %8.1f us/edit %6zu diags\n", defs,
+              open.count() * 1e3, secs[secs.size() / 2] * 1e6, diags.size());
+}
+
+int main() {
+  for (unsigned errors : { 0, 200 })
+    for (unsigned defs : { 20000, 200000 })
+      bench(defs, errors);
+  return 0;
+}
@@ -0,0 +1,321 @@
+// Microbenchmarks for the hot paths of parsing: stepping through a stream,
+// scanning runs of each character class with parse_many, the type signature
+// and definition rules, and error recovery with advance() on a source where
+// many definitions are broken. Sources come from corpus.h.
+//
+// Prints a table, or the same results as JSON with --json, for tracking
+// throughput and allocations across releases. With --corpus it prints the
+// error-dense source instead, so it can be fed to wildcat itself. --defs,
+// --width, --body, --error-rate and --seed set how sources are generated;
+// the error rate only applies to the error recovery benchmark.
+
+#include "corpus.h"
+#include "grammar.h"
+#include "json.h"
+#include "module.h"
+#include "parser.h"
+#include "scanner.h"
+#include "stream.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation through operator new, which is everything but the blocks
+// of an arena.
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept         { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Keeps results the benchmarks compute from being optimized away.
+static volatile size_t sink;
+
+struct result {
+  std::string name;
+  // What items is a count of, e.g. "defs".
+  const char *unit;
+  size_t      bytes, items;
+  double      secs;
+  // Per item, over one run.
+  double      allocs, arena_bytes;
+};
+
+// Runs fn, which processes bytes of source and returns how many items it
+// went through, a few times and keeps the fastest run. fn also gets a module
+// to parse into, fresh on every run.
+static result measure(const std::string &name, const char *unit,
+                      size_t bytes,
+                      const std::function<size_t(module&)> &fn) {
+  const unsigned runs = 5;
+  result r;
+  r.name = name;
+  r.unit = unit;
+  r.bytes = bytes;
+  r.secs = 0;
+  for (unsigned i = 0; i != runs; ++i) {
+    module mod;
+    size_t before = allocations;
+    auto begin = std::chrono::steady_clock::now();
+    r.items = fn(mod);
+    std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - begin;
+    r.allocs = double(allocations - before) / r.items;
+    r.arena_bytes = double(mod.get_arena().get_reserved()) / r.items;
+    if (i == 0 || secs.count() < r.secs)
+      r.secs = secs.count();
+  }
+  return r;
+}
+
+static result bench_next(const std::string &text) {
+  stream s("next", text);
+  stream::location start = s.get_loc();
+  return measure("stream.next", "chars", text.size(), [&](module&) {
+    s.set_loc(start);
+    size_t n = 0;
+    while (s.next())
+      ++n;
+    sink = s.get_loc().get_offset();
+    return n;
+  });
+}
+
+static result bench_peek(const std::string &text) {
+  stream s("peek", text);
+  stream::location start = s.get_loc();
+  return measure("stream.peek", "chars", text.size(), [&](module&) {
+    s.set_loc(start);
+    size_t n = 0, spaces = 0;
+    for (char c; (c = s.peek()); ++n) {
+      spaces += c == ' ';
+      s.next();
+    }
+    sink = spaces;
+    return n;
+  });
+}
+
+// Runs of the class separated by single characters outside it.
+static std::string make_runs(const scanner &scn, corpus_rng &rng,
+                             size_t size) {
+  const char *in = scn.get_kind() == scanner::kind::SPACE ? " \t\n" :
+                   "abcdefghijklmnopqrstuvwxyz0123456789_'";
+  char sep = scn.get_kind() == scanner::kind::SPACE ? 'x' : ' ';
+  size_t n = std::strlen(in);
+  std::string text;
+  while (text.size() < size) {
+    for (unsigned len = 1 + rng.below(16); len--;)
+      text += in[rng.below(n)];
+    text += sep;
+  }
+  return text;
+}
+
+static result bench_scan(const scanner &scn, const std::string &text) {
+  parser prs(stream("scan", text));
+  stream::location start = prs.get_stream().get_loc();
+  return measure(std::string("parse_many.") + scn.get_id(), "lexemes",
+                 text.size(), [&](module&) {
+    prs.get_stream().set_loc(start);
+    size_t n = 0, chars = 0;
+    while (prs.get_stream().peek()) {
+      chars += parse_many(prs, scn).size();
+      ++n;
+      prs.get_stream().next();
+    }
+    sink = chars;
+    return n;
+  });
+}
+
+static result bench_type_fn(unsigned width, size_t size) {
+  std::string sig = "(";
+  for (unsigned j = 0; j != width; ++j)
+    sig += (j ? " t" : "t") + std::to_string(j);
+  sig += " -> ";
+  for (unsigned j = width; j--;)
+    sig += "t" + std::to_string(j) + (j ? " " : ") ");
+  std::string text;
+  while (text.size() < size)
+    text += sig;
+
+  parser prs(stream("type_fn", text));
+  stream::location start = prs.get_stream().get_loc();
+  return measure("parse_type_fn", "sigs", text.size(), [&](module &mod) {
+    prs.get_stream().set_loc(start);
+    prs.set_module(&mod);
+    size_t n = 0;
+    for (; prs.get_stream().peek(); ++n) {
+      prs.reset();
+      if (!(prs >> parse_type_fn >> parse_maybe_spaces))
+        break;
+    }
+    prs.set_module(nullptr);
+    return n;
+  });
+}
+
+static result bench_def(const std::string &text, bool packrat) {
+  parser prs(stream("def", text));
+  stream::location start = prs.get_stream().get_loc();
+  prs.set_packrat(packrat);
+  return measure(packrat ? "parse_def.packrat" : "parse_def", "defs",
+                 text.size(), [&](module &mod) {
+    prs.get_stream().set_loc(start);
+    prs.set_module(&mod);
+    prs.reset();
+    size_t n = 0;
+    while (prs >> parse_maybe_spaces && prs.get_stream().peek()) {
+      prs.forget_runs();
+      if (!(prs >> parse_def))
+        break;
+      mod.add_def(prs.get_construct<construct_def>());
+      ++n;
+    }
+    prs.set_module(nullptr);
+    return n;
+  });
+}
+
+static result bench_advance(const std::string &text, unsigned defs) {
+  return measure("advance", "defs", text.size(), [&](module &mod) {
+    parser prs(stream("advance", text));
+    std::vector<parser::diagnostic> diags;
+    prs.set_diagnostics(diags);
+    mod = prs.parse();
+    sink = diags.size();
+    return defs;
+  });
+}
+
+static void print_table(const std::vector<result> &results) {
+  std::printf("%-22s %10s %14s %12s %12s\n", "benchmark", "MB/s",
+              "items/s", "allocs/item", "arena B/item");
+  for (const result &r : results)
+    std::printf("%-22s %10.1f %14.0f %12.3f %12.1f  (%s)\n", r.name.c_str(),
+                r.bytes / r.secs / 1e6, r.items / r.secs, r.allocs,
+                r.arena_bytes, r.unit);
+}
+
+static void print_json(const std::vector<result> &results,
+                       const corpus_options &opts) {
+  json corpus = json::object();
+  corpus.set("defs", opts.defs);
+  corpus.set("width", opts.width);
+  corpus.set("body", opts.body);
+  corpus.set("error_rate", opts.error_rate);
+  corpus.set("seed", double(opts.seed));
+
+  json list = json::array();
+  for (const result &r : results) {
+    json j = json::object();
+    j.set("name", r.name);
+    j.set("unit", r.unit);
+    j.set("bytes", double(r.bytes));
+    j.set("items", double(r.items));
+    j.set("seconds", r.secs);
+    j.set("mb_per_s", r.bytes / r.secs / 1e6);
+    j.set("items_per_s", r.items / r.secs);
+    j.set("allocs_per_item", r.allocs);
+    j.set("arena_bytes_per_item", r.arena_bytes);
+    list.push(std::move(j));
+  }
+
+  json out = json::object();
+  out.set("corpus", std::move(corpus));
+  out.set("benchmarks", std::move(list));
+  std::cout << out.to_string() << std::endl;
+}
+
+// Reads --name=value into n. Returns false if arg is some other option, and
+// exits if the value is malformed.
+template<typename T>
+static bool parse_opt(const char *arg, const char *name, T &n) {
+  size_t len = std::strlen(name);
+  if (std::strncmp(arg, name, len) != 0 || arg[len] != '=')
+    return false;
+  char *end;
+  double v = std::strtod(arg + len + 1, &end);
+  if (end == arg + len + 1 || *end || v < 0) {
+    std::fprintf(stderr, "Bad value: %s\n", arg);
+    std::exit(1);
+  }
+  n = v;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  corpus_options opts;
+  opts.error_rate = 0.5;
+  bool as_json = false, corpus = false;
+  for (int i = 1; i != argc; ++i) {
+    const char *arg = argv[i];
+    if (std::strcmp(arg, "--json") == 0)
+      as_json = true;
+    else if (std::strcmp(arg, "--corpus") == 0)
+      corpus = true;
+    else if (!parse_opt(arg, "--defs", opts.defs) &&
+             !parse_opt(arg, "--width", opts.width) &&
+             !parse_opt(arg, "--body", opts.body) &&
+             !parse_opt(arg, "--error-rate", opts.error_rate) &&
+             !parse_opt(arg, "--seed", opts.seed)) {
+      std::fprintf(stderr, "%s [--json] [--corpus] [--defs=<n>] "
+                   "[--width=<n>] [--body=<n>]\n%*s[--error-rate=<rate>] "
+                   "[--seed=<n>]\n", argv[0], int(std::strlen(argv[0])), "");
+      return 1;
+    }
+  }
+  if (!opts.defs || !opts.width || opts.error_rate > 1) {
+    std::fprintf(stderr, "Need at least one definition and type name, and "
+                 "an error rate of at most 1\n");
+    return 1;
+  }
+
+  std::string errors = make_corpus(opts);
+  if (corpus) {
+    std::cout << errors;
+    return 0;
+  }
+  corpus_options valid_opts = opts;
+  valid_opts.error_rate = 0;
+  std::string valid = make_corpus(valid_opts);
+
+  std::vector<result> results;
+  results.push_back(bench_next(valid));
+  results.push_back(bench_peek(valid));
+  corpus_rng rng(opts.seed);
+  for (const scanner *scn :
+       { &scanner::is_space, &scanner::is_ident, &scanner::is_word })
+    results.push_back(bench_scan(*scn, make_runs(*scn, rng, valid.size())));
+  results.push_back(bench_type_fn(opts.width, valid.size()));
+  results.push_back(bench_def(valid, false));
+  results.push_back(bench_def(valid, true));
+  results.push_back(bench_advance(errors, opts.defs));
+
+  for (const result &r : results)
+    if (r.unit == std::string("defs") && r.items != opts.defs) {
+      std::fprintf(stderr, "%s: parsed %zu of %u definitions\n",
+                   r.name.c_str(), r.items, opts.defs);
+      return 1;
+    }
+
+  if (as_json)
+    print_json(results, opts);
+  else
+    print_table(results);
+  return 0;
+}
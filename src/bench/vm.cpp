@@ -0,0 +1,91 @@
+// Runs shuffle-heavy definitions on the VM in a tight loop and reports how
+// many instructions it dispatches per second. "calls" runs a word built from
+// the shuffles defined in examples/valid/stackops.wc, so most of its work is
+// calls, frames and argument pushes; "prims" does the same shuffling with
+// only the primitive opcodes. Each runs once as written and once with its
+// shuffles fused, which is what counts per run.
+
+#include "compiler.h"
+#include "module.h"
+#include "parser.h"
+#include "stream.h"
+#include "vm.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const char stackops[] =
+  "dup+ : (a     -> a a)   (a)     -> a a   ;\n"
+  "drop : (a     ->)       (a)     ->       ;\n"
+  "rot  : (a b c -> b c a) (a b c) -> b c a ;\n"
+  "swap : (a b   -> b a)   (a b)   -> b a   ;\n"
+  "nip  : (a b   -> b)     (a b)   -> b     ;\n"
+  "-rot : (a b c -> c a b) (a b c) -> c a b ;\n"
+  "tuck : (a b   -> b a b) (a b)   -> b a b ;\n"
+  "over : (a b   -> a b a) (a b)   -> a b a ;\n"
+  "nip'  : (a b   -> b)     (a b)   -> a b swap drop ;\n"
+  "-rot' : (a b c -> c a b) (a b c) -> a b c rot rot ;\n"
+  "tuck' : (a b   -> b a b) (a b)   -> a b dup -rot  ;\n"
+  "over' : (a b   -> a b a) (a b)   -> a b swap tuck ;\n"
+  "nip''  : (a b   -> b)     -> swap drop ;\n"
+  "-rot'' : (a b c -> c a b) -> rot rot   ;\n"
+  "tuck'' : (a b   -> b a b) -> dup -rot  ;\n"
+  "over'' : (a b   -> a b a) -> swap tuck ;\n"
+  "2dup  : (a b -> a b a b) (a b) -> a b a b ;\n"
+  "2drop : (a b ->)         (a b) ->         ;\n"
+  "calls : (a b c -> a b c) (a b c) -> a b c rot -rot'' -rot' rot 2dup 2drop"
+  " over' drop tuck' drop swap dup+ drop over'' drop tuck'' drop swap"
+  " rot rot rot swap swap ;\n";
+
+static const char prims[] =
+  "prims : (a b c -> a b c) -> rot -rot rot -rot over drop tuck drop swap"
+  " dup drop over drop tuck drop swap rot rot rot swap swap ;\n";
+
+static void bench(const char *name, const char *source, bool fuse) {
+  parser prs(stream(name, source));
+  module mod = prs.parse();
+  program prog;
+  compiler comp(mod, prog);
+  comp.set_fuse(fuse);
+  std::vector<parser::diagnostic> diags;
+  if (!mod.is_valid() || !comp.compile(diags)) {
+    std::fprintf(stderr, "%s: failed to compile\n", name);
+    std::exit(1);
+  }
+
+  symbol word = mod.get_symbols().lookup(name);
+  vm machine(prog);
+  for (int64_t v = 1; v <= 3; ++v)
+    machine.push(v);
+
+  const unsigned runs = 2000000;
+  auto begin = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i != runs; ++i)
+    if (machine.run(word) != vm::status::OK) {
+      std::fprintf(stderr, "%s: run failed\n", name);
+      std::exit(1);
+    }
+  std::chrono::duration<double> secs =
+    std::chrono::steady_clock::now() - begin;
+
+  if (machine.get_depth() != 3 || machine.get(0) != 1 ||
+      machine.get(1) != 2 || machine.get(2) != 3) {
+    std::fprintf(stderr, "%s: wrong result\n", name);
+    std::exit(1);
+  }
+  double rate = machine.get_dispatches() / secs.count();
+  std::printf("%-6s %-7s %12.0f dispatches/s %10.0f runs/s %6.1f per run\n",
+              name, fuse ? "fused" : "as-is", rate, runs / secs.count(),
+              double(machine.get_dispatches()) / runs);
+}
+
+int main() {
+  bench("calls", stackops, false);
+  bench("calls", stackops, true);
+  bench("prims", prims, false);
+  bench("prims", prims, true);
+  return 0;
+}
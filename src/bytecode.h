@@ -0,0 +1,78 @@
+#pragma once
+
+#include "symbol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The compiled form of a module. Code is a flat byte array; every
+// instruction is a one-byte opcode, followed for a few by an operand.
+class program {
+public:
+  enum class op : uint8_t {
+    HALT,
+    // The stack primitives.
+    DUP, DROP, SWAP, ROT, OVER, NIP, TUCK, NROT,
+    // Followed by the 8-bit number of values to take and of values to
+    // leave, then for each of the latter the 8-bit index of its input.
+    SHUFFLE,
+    // Followed by the 32-bit offset of the word to call.
+    CALL,
+    // Followed by the 8-bit index of the argument to push.
+    LOCAL,
+    // Followed by the 8-bit number of arguments to pop into a new frame.
+    ENTER,
+    // Returns from a word without a frame, and from one with a frame.
+    RET, LEAVE
+  };
+
+  // A compiled word.
+  struct word {
+    word() : entry(UINT32_MAX), inputs(0), outputs(0) { }
+
+    uint32_t entry;
+    uint32_t inputs, outputs;
+  };
+
+  // Every program starts with a HALT, which is where the outermost call
+  // returns to.
+  program() : max_growth_(0) { code_.push_back(uint8_t(op::HALT)); }
+
+  const uint8_t *get_code()      const { return code_.data(); }
+  size_t         get_code_size() const { return code_.size(); }
+
+  // The most any one word can grow the stack by before it calls another.
+  uint32_t get_max_growth()           const { return max_growth_;  }
+  void     set_max_growth(uint32_t n)       { max_growth_ = n;     }
+
+  // Returns the word with the given name. Its entry is UINT32_MAX if there
+  // is no such word.
+  word get_word(symbol sym) const {
+    return sym.get_id() < words_.size() ? words_[sym.get_id()] : word();
+  }
+  void set_word(symbol sym, word w) {
+    if (sym.get_id() >= words_.size())
+      words_.resize(sym.get_id() + 1);
+    words_[sym.get_id()] = w;
+  }
+
+  uint32_t get_offset() const { return code_.size(); }
+
+  void emit(op o)          { code_.push_back(uint8_t(o)); }
+  void emit_u8(uint8_t n)  { code_.push_back(n); }
+  void emit_u32(uint32_t n) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &n, sizeof(n));
+    code_.insert(code_.end(), bytes, bytes + 4);
+  }
+  void patch_u32(uint32_t offset, uint32_t n) {
+    std::memcpy(&code_[offset], &n, sizeof(n));
+  }
+
+private:
+  std::vector<uint8_t> code_;
+  std::vector<word>    words_;
+  uint32_t             max_growth_;
+};
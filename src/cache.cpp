@@ -0,0 +1,355 @@
+#include "cache.h"
+#include "construct.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// An image is a header, two tables of 32-bit words, the definitions' records
+// and then the symbol names. The first table has an (offset, length) pair per
+// symbol naming its text, the second the offset of each definition's record.
+// A record is the definition's offset in the source and the name's symbol
+// id, then the type's input list and output compound, the argument list and
+// the body. A compound is a count followed by that many symbol ids and a list
+// is a count followed by that many compounds. Records are made of LEB128
+// varints, since nearly every number in them fits in a byte or two. All
+// offsets are in bytes from the start of the image.
+
+namespace {
+
+const char     image_magic[8] = { 'w', 'c', 'a', 's', 't', '\0', '\0', '\0' };
+// Bump whenever the layout of an image changes.
+const uint32_t image_version  = 3;
+
+struct header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t size;
+  uint64_t source_hash, source_size;
+  uint32_t num_syms, syms;
+  uint32_t num_defs, defs;
+};
+
+// Serializes definitions into the records of an image.
+class image_writer {
+public:
+  image_writer(std::string &out) : out_(out) { }
+
+  void put(uint64_t n) {
+    for (; n >= 0x80; n >>= 7)
+      out_.push_back(static_cast<char>(n | 0x80));
+    out_.push_back(static_cast<char>(n));
+  }
+
+  template<typename T>
+  void put_compound(const construct_vec<T> *c) {
+    construct_list<T> list = c->get_list();
+    put(list.size());
+    for (T *t : list)
+      put(t->get_sym().get_id());
+  }
+
+  template<typename T>
+  void put_list(const construct_vec<T> *c) {
+    construct_list<T> list = c->get_list();
+    put(list.size());
+    for (T *t : list)
+      put_compound(t);
+  }
+
+  void put_def(const construct_def *def) {
+    put(def->get_loc().get_offset());
+    put(def->get_name()->get_sym().get_id());
+    put_list(def->get_type()->get_inp());
+    put_compound(def->get_type()->get_out());
+    put_list(def->get_args());
+    put_compound(def->get_body());
+  }
+
+private:
+  std::string &out_;
+};
+
+// Rebuilds definitions from the records of an image, checking every count and
+// symbol id against the bounds of the image as it goes.
+class image_reader {
+public:
+  image_reader(module &mod, const std::vector<symbol> &syms,
+               const unsigned char *cur, const unsigned char *end)
+    : mod_(mod), syms_(syms), cur_(cur), end_(end), ok_(true) {
+  }
+
+  bool is_ok() const { return ok_; }
+
+  construct_def *read_def() {
+    uint64_t offset = next();
+    auto name = make<construct_word>(read_sym());
+    auto inp = read_list<construct_type_list, construct_type_compound,
+                         construct_type_id>();
+    auto out = read_compound<construct_type_compound, construct_type_id>();
+    auto args = read_list<construct_arg_list, construct_arg_compound,
+                          construct_arg_id>();
+    auto body = read_compound<construct_body, construct_word>();
+    return make<construct_def>(name, make<construct_type_fn>(inp, out),
+                               args, body,
+                               stream::location(offset));
+  }
+
+private:
+  template<typename T, typename... Args>
+  T *make(Args&&... args) {
+    return mod_.get_arena().make<T>(std::forward<Args>(args)...);
+  }
+
+  uint64_t next() {
+    uint64_t n = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (cur_ == end_)
+        break;
+      unsigned char c = *cur_++;
+      n |= static_cast<uint64_t>(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        return n;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  // Reads a count, which can't be more than the number of bytes left since
+  // every element takes at least one.
+  uint32_t read_count() {
+    uint64_t n = next();
+    if (n > static_cast<size_t>(end_ - cur_)) {
+      ok_ = false;
+      return 0;
+    }
+    return n;
+  }
+
+  symbol read_sym() {
+    uint64_t id = next();
+    if (id >= syms_.size()) {
+      ok_ = false;
+      return symbol();
+    }
+    return syms_[id];
+  }
+
+  template<typename C, typename T>
+  C *read_compound() {
+    uint32_t n = read_count();
+    T **list = mod_.get_arena().make_array<T*>(n);
+    for (uint32_t i = 0; i != n; ++i)
+      list[i] = make<T>(read_sym());
+    return make<C>(construct_list<T>(list, list + n));
+  }
+
+  template<typename L, typename C, typename T>
+  L *read_list() {
+    uint32_t n = read_count();
+    C **list = mod_.get_arena().make_array<C*>(n);
+    for (uint32_t i = 0; i != n; ++i)
+      list[i] = read_compound<C, T>();
+    return make<L>(construct_list<C>(list, list + n));
+  }
+
+  module                    &mod_;
+  const std::vector<symbol> &syms_;
+  const unsigned char       *cur_, *end_;
+  bool                       ok_;
+};
+
+} // end anonymous namespace
+
+ast_cache::key ast_cache::get_key(std::string_view source) {
+  // FNV-1a a word at a time, with a shift folding the high bits back down
+  // since the multiply only carries upwards.
+  const uint64_t prime = 0x100000001b3ull;
+  uint64_t h = 0xcbf29ce484222325ull;
+  const char *p = source.data(), *end = p + source.size();
+  for (; end - p >= 8; p += 8) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    h = (h ^ w) * prime;
+    h ^= h >> 29;
+  }
+  for (; p != end; ++p)
+    h = (h ^ static_cast<unsigned char>(*p)) * prime;
+  return key{h, source.size()};
+}
+
+std::string ast_cache::get_path(key k) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016llx.ast",
+                static_cast<unsigned long long>(k.hash));
+  return dir_ + name;
+}
+
+ast_cache::image::image(image &&other)
+  : data_(other.data_), size_(other.size_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+ast_cache::image::~image() {
+  if (data_)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+ast_cache::image& ast_cache::image::operator=(image &&other) {
+  if (this != &other) {
+    if (data_)
+      munmap(const_cast<char*>(data_), size_);
+    data_ = other.data_;
+    size_ = other.size_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+uint32_t ast_cache::image::get_num_defs() const {
+  return reinterpret_cast<const header*>(data_)->num_defs;
+}
+
+uint32_t ast_cache::image::get_num_syms() const {
+  return reinterpret_cast<const header*>(data_)->num_syms;
+}
+
+bool ast_cache::image::read(module &mod) const {
+  const header &h = *reinterpret_cast<const header*>(data_);
+  const uint32_t *words = reinterpret_cast<const uint32_t*>(data_);
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data_);
+  if (h.syms % 4 || h.defs % 4 || h.syms > size_ || h.defs > size_ ||
+      (size_ - h.syms) / 8 < h.num_syms || (size_ - h.defs) / 4 < h.num_defs)
+    return false;
+
+  std::vector<symbol> syms;
+  syms.reserve(h.num_syms);
+  const uint32_t *sym = words + h.syms / 4;
+  for (uint32_t i = 0; i != h.num_syms; ++i, sym += 2) {
+    if (sym[0] > size_ || sym[1] > size_ - sym[0])
+      return false;
+    syms.push_back(mod.get_symbols().intern(
+      std::string_view(data_ + sym[0], sym[1])));
+  }
+
+  const uint32_t *def = words + h.defs / 4;
+  for (uint32_t i = 0; i != h.num_defs; ++i) {
+    if (def[i] > size_)
+      return false;
+    image_reader r(mod, syms, bytes + def[i], bytes + size_);
+    construct_def *d = r.read_def();
+    if (!r.is_ok())
+      return false;
+    mod.add_def(d);
+  }
+  return true;
+}
+
+ast_cache::image ast_cache::lookup(key k) const {
+  image img;
+  int fd = open(get_path(k).c_str(), O_RDONLY);
+  if (fd < 0)
+    return img;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(header)) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      img.data_ = static_cast<const char*>(addr);
+      img.size_ = st.st_size;
+    }
+  }
+  close(fd);
+  if (!img.is_valid())
+    return img;
+
+  // A hash collision, a stale layout or a truncated write all show up here.
+  const header &h = *reinterpret_cast<const header*>(img.data_);
+  if (std::memcmp(h.magic, image_magic, sizeof(image_magic)) != 0 ||
+      h.version != image_version || h.size != img.size_ ||
+      h.source_hash != k.hash || h.source_size != k.size)
+    return image();
+  return img;
+}
+
+bool ast_cache::make_image(key k, const module &mod, std::string &out) {
+  const symbol_table &syms = mod.get_symbols();
+  const std::vector<construct_def*> &defs = mod.get_defs();
+
+  // Lay out the tables first, then fill them in as the records and names
+  // get placed.
+  size_t base = sizeof(header);
+  std::vector<uint32_t> words(2 * syms.size() + defs.size());
+  size_t records = base + 4 * words.size();
+  std::string recs;
+  image_writer w(recs);
+  for (size_t i = 0, e = defs.size(); i != e; ++i) {
+    words[2 * syms.size() + i] = records + recs.size();
+    w.put_def(defs[i]);
+  }
+  size_t names = records + recs.size(), names_size = 0;
+  for (uint32_t i = 0, e = syms.size(); i != e; ++i) {
+    std::string_view name = syms.get_name(symbol(i));
+    words[2 * i] = names + names_size;
+    words[2 * i + 1] = name.size();
+    names_size += name.size();
+  }
+  if (names + names_size > UINT32_MAX)
+    return false;
+
+  header h;
+  std::memcpy(h.magic, image_magic, sizeof(image_magic));
+  h.version = image_version;
+  h.size = names + names_size;
+  h.source_hash = k.hash;
+  h.source_size = k.size;
+  h.num_syms = syms.size();
+  h.syms = base;
+  h.num_defs = defs.size();
+  h.defs = base + 8 * syms.size();
+
+  out.reserve(out.size() + h.size);
+  out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.append(reinterpret_cast<const char*>(words.data()), 4 * words.size());
+  out.append(recs);
+  for (uint32_t i = 0, e = syms.size(); i != e; ++i)
+    out.append(syms.get_name(symbol(i)));
+  return true;
+}
+
+bool ast_cache::store(key k, const module &mod) const {
+  std::string buf;
+  if (!make_image(k, mod, buf))
+    return false;
+
+  // Write to a file of our own and rename it into place, so readers never
+  // see a partial image even with several writers.
+  mkdir(dir_.c_str(), 0777);
+  std::string path = get_path(k);
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    return false;
+  fchmod(fd, 0644);
+  const char *p = buf.data(), *end = p + buf.size();
+  while (p != end) {
+    ssize_t n = write(fd, p, end - p);
+    if (n <= 0)
+      break;
+    p += n;
+  }
+  bool ok = close(fd) == 0 && p == end &&
+            rename(tmp.c_str(), path.c_str()) == 0;
+  if (!ok)
+    unlink(tmp.c_str());
+  return ok;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "module.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// A directory of binary images of parsed modules, keyed by a hash of the
+// source text each was parsed from. Looking up an unchanged file costs a hash
+// of its text and an mmap of its image.
+class ast_cache {
+public:
+  explicit ast_cache(std::string dir) : dir_(std::move(dir)) { }
+
+  // Identifies a source text.
+  struct key {
+    uint64_t hash;
+    uint64_t size;
+  };
+
+  static key get_key(std::string_view source);
+
+  // A module image mapped from the cache. The image holds only 32-bit counts,
+  // symbol ids and offsets from its own start, so it's read in place wherever
+  // it's mapped, without any fixing up.
+  class image {
+  public:
+    image() : data_(nullptr), size_(0) { }
+    image(image &&other);
+    ~image();
+
+    image& operator=(image &&other);
+
+    bool is_valid() const { return data_ != nullptr; }
+
+    uint32_t get_num_defs() const;
+    uint32_t get_num_syms() const;
+
+    // Rebuilds the module the image was made of, appending its definitions to
+    // mod. Returns false if the image turns out to be corrupt.
+    bool read(module &mod) const;
+
+  private:
+    friend class ast_cache;
+
+    image(const image&) = delete;
+    image& operator=(const image&) = delete;
+
+    const char *data_;
+    size_t      size_;
+  };
+
+  // Returns the image cached for the source text with the given key, or an
+  // invalid image if there is none.
+  image lookup(key k) const;
+
+  // Appends an image of a module parsed from the source text with the given
+  // key to out, laid out as store() caches it. Returns false if the module is
+  // too big for an image's 32-bit offsets.
+  static bool make_image(key k, const module &mod, std::string &out);
+
+  // Caches an image of a module parsed from the source text with the given
+  // key. Returns whether it was stored; failing to is not an error, since the
+  // cache only saves work.
+  bool store(key k, const module &mod) const;
+
+private:
+  std::string get_path(key k) const;
+
+  std::string dir_;
+};
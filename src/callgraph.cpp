@@ -0,0 +1,219 @@
+#include "callgraph.h"
+
+#include <algorithm>
+#include <utility>
+
+const uint32_t call_graph::none;
+
+call_graph::call_graph(const module &mod) {
+  add_calls(mod);
+  find_parts();
+  find_sccs(nullptr);
+}
+
+call_graph::call_graph(const module &mod, thread_pool &pool) {
+  add_calls(mod);
+  find_parts();
+  find_sccs(&pool);
+}
+
+void call_graph::add_calls(const module &mod) {
+  const std::vector<construct_def*> &defs = mod.get_defs();
+  first_.assign(mod.get_symbols().size(), none);
+  for (uint32_t i = 0; i != defs.size(); ++i) {
+    uint32_t &first = first_[defs[i]->get_name()->get_sym().get_id()];
+    if (first == none)
+      first = i;
+  }
+
+  // The last definition to add an edge to each callee, to skip repeats.
+  std::vector<uint32_t> seen(defs.size(), none);
+  std::vector<symbol> args;
+  callee_start_.reserve(defs.size() + 1);
+  for (uint32_t i = 0; i != defs.size(); ++i) {
+    callee_start_.push_back(callees_.size());
+    args.clear();
+    for (construct_arg_compound *c : defs[i]->get_args()->get_list())
+      for (construct_arg_id *id : c->get_list())
+        args.push_back(id->get_sym());
+
+    for (construct_word *word : defs[i]->get_body()->get_list()) {
+      uint32_t callee = lookup(word->get_sym());
+      if (callee == none || seen[callee] == i ||
+          std::find(args.begin(), args.end(), word->get_sym()) != args.end())
+        continue;
+      seen[callee] = i;
+      callees_.push_back(callee);
+    }
+  }
+  callee_start_.push_back(callees_.size());
+}
+
+void call_graph::find_parts() {
+  const uint32_t n = callee_start_.size() - 1;
+
+  // A union-find forest in which every tree's root is its lowest definition.
+  std::vector<uint32_t> parent(n);
+  for (uint32_t v = 0; v != n; ++v)
+    parent[v] = v;
+  auto find = [&](uint32_t v) {
+    while (parent[v] != v)
+      v = parent[v] = parent[parent[v]];
+    return v;
+  };
+  for (uint32_t v = 0; v != n; ++v)
+    for (uint32_t e = callee_start_[v]; e != callee_start_[v + 1]; ++e) {
+      uint32_t a = find(v), b = find(callees_[e]);
+      if (a != b)
+        parent[std::max(a, b)] = std::min(a, b);
+    }
+
+  // Number the parts in the order of their first definitions, then list
+  // each one's definitions in order.
+  part_.resize(n);
+  part_start_.assign(1, 0);
+  for (uint32_t v = 0; v != n; ++v) {
+    uint32_t root = find(v);
+    if (root == v) {
+      part_[v] = part_start_.size() - 1;
+      part_start_.push_back(0);
+    } else {
+      part_[v] = part_[root];
+    }
+    ++part_start_[part_[v] + 1];
+  }
+  for (size_t p = 1; p != part_start_.size(); ++p)
+    part_start_[p] += part_start_[p - 1];
+
+  members_.resize(n);
+  std::vector<uint32_t> next(part_start_.begin(), part_start_.end() - 1);
+  for (uint32_t v = 0; v != n; ++v)
+    members_[next[part_[v]]++] = v;
+}
+
+void call_graph::find_sccs(thread_pool *pool) {
+  const uint32_t n = callee_start_.size() - 1;
+  const uint32_t parts = part_start_.size() - 1;
+  std::vector<uint32_t> index(n, none), low(n), num_sccs(parts);
+  scc_.assign(n, none);
+  recursive_.assign(n, false);
+  order_.resize(n);
+
+  // Runs of parts big enough between them to be worth a task each, so a
+  // module of many small parts isn't done one tiny task at a time.
+  uint32_t grain = pool ? std::max<uint32_t>(n / (pool->size() * 8), 1024) :
+                          n;
+  std::vector<uint32_t> runs(1, 0);
+  for (uint32_t p = 0; p != parts; ++p)
+    if (part_start_[p + 1] - part_start_[runs.back()] >= grain)
+      runs.push_back(p + 1);
+  if (runs.back() != parts)
+    runs.push_back(parts);
+
+  auto run = [&](size_t i) {
+    find_sccs(runs[i], runs[i + 1], index, low, num_sccs);
+  };
+  if (pool) {
+    pool->parallel_for(runs.size() - 1, run);
+  } else {
+    for (size_t i = 0; i + 1 < runs.size(); ++i)
+      run(i);
+  }
+
+  // Number the components across parts, in the order they came out.
+  std::vector<uint32_t> first_scc(parts);
+  for (uint32_t p = 0, next = 0; p != parts; ++p) {
+    first_scc[p] = next;
+    next += num_sccs[p];
+  }
+  for (uint32_t v = 0; v != n; ++v)
+    scc_[v] += first_scc[part_[v]];
+}
+
+void call_graph::find_sccs(uint32_t begin, uint32_t end,
+                           std::vector<uint32_t> &index,
+                           std::vector<uint32_t> &low,
+                           std::vector<uint32_t> &num_sccs) {
+  std::vector<uint32_t> stack;
+  // The definitions being visited, each with the next callee to look at.
+  std::vector<std::pair<uint32_t, uint32_t>> visits;
+  uint32_t next_index = 0;
+  // Where the next definition to finish goes in order_.
+  uint32_t out = part_start_[begin];
+
+  // A definition that has been visited is on the stack until its component
+  // has been numbered.
+  auto visit = [&](uint32_t v) {
+    index[v] = low[v] = next_index++;
+    stack.push_back(v);
+    visits.emplace_back(v, callee_start_[v]);
+  };
+
+  for (uint32_t p = begin; p != end; ++p) {
+    uint32_t next_scc = 0;
+    for (uint32_t m = part_start_[p]; m != part_start_[p + 1]; ++m) {
+      uint32_t root = members_[m];
+      if (index[root] != none)
+        continue;
+      visit(root);
+
+      while (!visits.empty()) {
+        uint32_t v = visits.back().first;
+        uint32_t &e = visits.back().second;
+        if (e != callee_start_[v + 1]) {
+          uint32_t w = callees_[e++];
+          if (w == v)
+            recursive_[v] = true;
+          if (index[w] == none)
+            visit(w);
+          else if (scc_[w] == none)
+            low[v] = std::min(low[v], index[w]);
+          continue;
+        }
+
+        visits.pop_back();
+        if (!visits.empty()) {
+          uint32_t parent = visits.back().first;
+          low[parent] = std::min(low[parent], low[v]);
+        }
+        if (low[v] != index[v])
+          continue;
+
+        // v is the root of a component: everything above it on the stack.
+        uint32_t first = out, w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          scc_[w] = next_scc;
+          order_[out++] = w;
+        } while (w != v);
+        if (out - first > 1)
+          for (uint32_t i = first; i != out; ++i)
+            recursive_[order_[i]] = true;
+        ++next_scc;
+      }
+    }
+    num_sccs[p] = next_scc;
+  }
+}
+
+std::vector<bool>
+call_graph::get_reachable(const std::vector<uint32_t> &roots) const {
+  std::vector<bool> reached(size());
+  std::vector<uint32_t> work;
+  for (uint32_t root : roots)
+    if (!reached[root]) {
+      reached[root] = true;
+      work.push_back(root);
+    }
+  while (!work.empty()) {
+    uint32_t v = work.back();
+    work.pop_back();
+    for (const uint32_t *w = callees_begin(v); w != callees_end(v); ++w)
+      if (!reached[*w]) {
+        reached[*w] = true;
+        work.push_back(*w);
+      }
+  }
+  return reached;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "module.h"
+#include "symbol.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+// The calls between the definitions of a module, which are numbered by their
+// position in it. A word in a body calls the first definition of its name,
+// unless one of the body's arguments has the same name.
+class call_graph {
+public:
+  static const uint32_t none = UINT32_MAX;
+
+  explicit call_graph(const module &mod);
+  // Same, but finds the strongly connected components of separate parts of
+  // the graph in parallel on the given pool. The results are the same.
+  call_graph(const module &mod, thread_pool &pool);
+
+  size_t size() const { return scc_.size(); }
+
+  // The definition a name calls, or none.
+  uint32_t lookup(symbol sym) const {
+    return sym.get_id() < first_.size() ? first_[sym.get_id()] : none;
+  }
+
+  // The definitions one calls, each once, in the order first called.
+  const uint32_t *callees_begin(uint32_t def) const {
+    return callees_.data() + callee_start_[def];
+  }
+  const uint32_t *callees_end(uint32_t def) const {
+    return callees_.data() + callee_start_[def + 1];
+  }
+
+  // Every definition, ordered so that callees come before their callers
+  // except within a strongly connected component, whose members are next to
+  // each other.
+  const std::vector<uint32_t> &get_order() const { return order_; }
+
+  // The number of the component a definition is in. Components are numbered
+  // in the order they appear in get_order().
+  uint32_t get_scc(uint32_t def) const { return scc_[def]; }
+
+  // Whether a definition can end up calling itself.
+  bool is_recursive(uint32_t def) const { return recursive_[def]; }
+
+  // Which definitions the given ones call, directly or not, including the
+  // given ones themselves.
+  std::vector<bool> get_reachable(const std::vector<uint32_t> &roots) const;
+
+private:
+  call_graph(const call_graph&) = delete;
+  call_graph& operator=(const call_graph&) = delete;
+
+  void add_calls(const module &mod);
+
+  // Splits the definitions into the weakly connected parts of the graph,
+  // those that are connected if calls are followed either way. No call
+  // crosses from one part to another, so each one's components can be found
+  // on their own.
+  void find_parts();
+
+  // Finds the strongly connected components with Tarjan's algorithm, which
+  // produces them callees first, on the pool if there is one. Parts are laid
+  // out in get_order() one after another, by their first definition.
+  void find_sccs(thread_pool *pool);
+
+  // Runs Tarjan's algorithm over the parts in [begin, end), numbering each
+  // one's components from zero and counting them in num_sccs. index and low
+  // are the algorithm's numbers for each definition. It keeps its own stack
+  // so deep chains of calls don't overflow the real one.
+  void find_sccs(uint32_t begin, uint32_t end, std::vector<uint32_t> &index,
+                 std::vector<uint32_t> &low, std::vector<uint32_t> &num_sccs);
+
+  std::vector<uint32_t> first_;
+  std::vector<uint32_t> callee_start_, callees_;
+  // The part each definition is in, and the definitions of each part.
+  std::vector<uint32_t> part_, part_start_, members_;
+  std::vector<uint32_t> order_, scc_;
+  // Bytes rather than bits, so parts can be done on separate threads.
+  std::vector<uint8_t>  recursive_;
+};
@@ -0,0 +1,259 @@
+#include "check.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// The type variables in play while checking one body, unified with a
+// union-find. Rigid variables never get bound to anything but themselves, so
+// they always end up as the root of their class.
+class unifier {
+public:
+  uint32_t add(bool rigid) {
+    parent_.push_back(parent_.size());
+    rigid_.push_back(rigid);
+    return parent_.size() - 1;
+  }
+
+  uint32_t find(uint32_t v) {
+    while (parent_[v] != v) {
+      parent_[v] = parent_[parent_[v]];
+      v = parent_[v];
+    }
+    return v;
+  }
+
+  bool unify(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+      return true;
+    if (rigid_[a] && rigid_[b])
+      return false;
+    if (rigid_[a])
+      std::swap(a, b);
+    parent_[a] = b;
+    return true;
+  }
+
+private:
+  std::vector<uint32_t> parent_;
+  std::vector<bool>     rigid_;
+};
+
+// A primitive word's stack effect, in terms of numbered variables.
+struct builtin {
+  const char             *name;
+  std::vector<uint32_t>   inp, out;
+};
+
+const builtin builtins[] = {
+  { "dup",  { 0 },       { 0, 0 }       },
+  { "drop", { 0 },       { }            },
+  { "swap", { 0, 1 },    { 1, 0 }       },
+  { "rot",  { 0, 1, 2 }, { 1, 2, 0 }    },
+  { "over", { 0, 1 },    { 0, 1, 0 }    },
+};
+
+std::string quote(std::string_view name) {
+  std::string s(1, '\'');
+  s.append(name);
+  s.push_back('\'');
+  return s;
+}
+
+std::string duplicate_message(std::string_view name) {
+  return "duplicate definition of " + quote(name) + ", which is ignored";
+}
+
+} // end anonymous namespace
+
+checker::checker(const flat_ast &ast) : ast_(ast) {
+}
+
+checker::signature checker::resolve(ast_type_fn type) {
+  signature sig;
+  auto var = [&sig](symbol name) -> uint32_t {
+    auto it = std::find(sig.names.begin(), sig.names.end(), name);
+    if (it != sig.names.end())
+      return it - sig.names.begin();
+    sig.names.push_back(name);
+    return sig.num_vars++;
+  };
+  for (ast_type_compound c : type.get_inp()) {
+    sig.shape.push_back(c.size());
+    for (ast_type_id id : c)
+      sig.inp.push_back(var(id.get_sym()));
+  }
+  for (ast_type_id id : type.get_out())
+    sig.out.push_back(var(id.get_sym()));
+  return sig;
+}
+
+void checker::add_builtins() {
+  builtins_.reserve(sizeof(builtins) / sizeof(builtins[0]));
+  for (const builtin &b : builtins) {
+    symbol sym = ast_.get_symbols().lookup(b.name);
+    if (!sym.is_valid() || words_[sym.get_id()])
+      continue;
+    signature sig;
+    sig.inp = b.inp;
+    sig.out = b.out;
+    for (uint32_t v : b.inp)
+      sig.num_vars = std::max(sig.num_vars, v + 1);
+    builtins_.push_back(sig);
+    words_[sym.get_id()] = &builtins_.back();
+  }
+}
+
+std::string checker::check_def(ast_def def, const signature &sig) const {
+  const symbol_table &syms = ast_.get_symbols();
+  unifier u;
+  // The definition's own variables come first, so their ids are their
+  // numbers in the signature.
+  for (uint32_t i = 0; i != sig.num_vars; ++i)
+    u.add(true);
+  auto name_of = [&](uint32_t v) {
+    return quote(syms.get_name(sig.names[u.find(v)]));
+  };
+
+  // Arguments bind the inputs compound by compound; without them the inputs
+  // start out on the stack.
+  std::vector<std::pair<symbol, uint32_t>> args;
+  std::vector<uint32_t> stack;
+  ast_arg_list arg_list = def.get_args();
+  if (arg_list.empty()) {
+    stack = sig.inp;
+  } else {
+    if (arg_list.size() != sig.shape.size())
+      return "arguments don't match the input type";
+    uint32_t next = 0;
+    for (size_t i = 0, e = arg_list.size(); i != e; ++i) {
+      ast_arg_compound ids = arg_list[i];
+      if (ids.size() != sig.shape[i])
+        return "arguments don't match the input type";
+      for (ast_arg_id id : ids)
+        args.emplace_back(id.get_sym(), sig.inp[next++]);
+    }
+  }
+
+  for (ast_word word : def.get_body()) {
+    symbol sym = word.get_sym();
+    // Arguments shadow words of the same name.
+    auto arg = std::find_if(args.rbegin(), args.rend(),
+                            [sym](const std::pair<symbol, uint32_t> &a) {
+                              return a.first == sym;
+                            });
+    if (arg != args.rend()) {
+      stack.push_back(arg->second);
+      continue;
+    }
+
+    const signature *callee = words_[sym.get_id()];
+    std::string name = quote(syms.get_name(sym));
+    if (!callee)
+      return "unknown word " + name;
+    size_t n = callee->inp.size();
+    if (stack.size() < n)
+      return name + " takes " + std::to_string(n) +
+             " values, but the stack only has " +
+             std::to_string(stack.size());
+
+    // Instantiate the callee's variables afresh for this call.
+    uint32_t base = u.add(false);
+    for (uint32_t i = 1; i < callee->num_vars; ++i)
+      u.add(false);
+    size_t top = stack.size() - n;
+    for (size_t i = 0; i != n; ++i)
+      if (!u.unify(base + callee->inp[i], stack[top + i]))
+        return name + " needs " + name_of(base + callee->inp[i]) +
+               " where the stack has " + name_of(stack[top + i]);
+    stack.resize(top);
+    for (uint32_t v : callee->out)
+      stack.push_back(base + v);
+  }
+
+  if (stack.size() != sig.out.size())
+    return "the body leaves " + std::to_string(stack.size()) +
+           " values, but the type declares " +
+           std::to_string(sig.out.size());
+  for (size_t i = 0, e = stack.size(); i != e; ++i)
+    if (!u.unify(stack[i], sig.out[i]))
+      return "the body leaves " + name_of(stack[i]) +
+             " where the type declares " + name_of(sig.out[i]);
+  return std::string();
+}
+
+bool checker::check(thread_pool &pool,
+                    std::vector<parser::diagnostic> &diags) {
+  size_t num_defs = ast_.get_num_defs();
+
+  // Resolve every signature before checking any body. Since every word's
+  // type is declared, no body's check depends on another's, so both passes
+  // are fully parallel.
+  sigs_.resize(num_defs);
+  pool.parallel_for(num_defs, [&](size_t i) {
+    sigs_[i] = resolve(ast_.get_def(i).get_type());
+  });
+
+  // The first definition of a name is the one that counts.
+  words_.assign(ast_.get_symbols().size(), nullptr);
+  for (size_t i = 0; i != num_defs; ++i) {
+    symbol name = ast_.get_def(i).get_name().get_sym();
+    const signature *&word = words_[name.get_id()];
+    if (!word)
+      word = &sigs_[i];
+  }
+  add_builtins();
+
+  // Every word a body calls that is neither defined nor a primitive is
+  // reported, once per definition, and the definition isn't checked any
+  // further.
+  const symbol_table &syms = ast_.get_symbols();
+  def_index index(ast_);
+  std::vector<std::vector<symbol>> unknown(num_defs);
+  for (const def_index::call_site &site : index.get_undefined()) {
+    symbol sym = ast_.get_sym(site.node);
+    std::vector<symbol> &words = unknown[site.def];
+    if (!words_[sym.get_id()] &&
+        std::find(words.begin(), words.end(), sym) == words.end())
+      words.push_back(sym);
+  }
+
+  std::vector<std::string> errors(num_defs);
+  pool.parallel_for(num_defs, [&](size_t i) {
+    if (unknown[i].empty())
+      errors[i] = check_def(ast_.get_def(i), sigs_[i]);
+  });
+
+  const std::vector<uint32_t> &dups = index.get_duplicates();
+  auto dup = dups.begin();
+  size_t before = diags.size();
+  for (size_t i = 0; i != num_defs; ++i) {
+    stream::location loc = ast_.get_loc(i);
+    if (dup != dups.end() && *dup == i) {
+      symbol name = ast_.get_def(i).get_name().get_sym();
+      diags.push_back(
+        parser::diagnostic(loc, duplicate_message(syms.get_name(name))));
+      ++dup;
+    }
+    for (symbol sym : unknown[i])
+      diags.push_back(parser::diagnostic(
+        loc, "unknown word " + quote(syms.get_name(sym))));
+    if (!errors[i].empty())
+      diags.push_back(parser::diagnostic(loc, errors[i]));
+  }
+  return diags.size() == before;
+}
+
+bool checker::check_duplicates(std::vector<parser::diagnostic> &diags) {
+  const symbol_table &syms = ast_.get_symbols();
+  def_index index(ast_);
+  for (uint32_t i : index.get_duplicates()) {
+    symbol name = ast_.get_def(i).get_name().get_sym();
+    diags.push_back(parser::diagnostic(
+      ast_.get_loc(i), duplicate_message(syms.get_name(name))));
+  }
+  return index.get_duplicates().empty();
+}
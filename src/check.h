@@ -0,0 +1,72 @@
+#pragma once
+
+#include "defindex.h"
+#include "flat_ast.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks that the body of every definition has the stack effect its type
+// declares. A body is run abstractly on a stack of types: arguments push the
+// types they are bound to and every other word pops its inputs off the stack,
+// unifying them with the types there, and pushes its outputs. What's left must
+// be the declared output.
+//
+// Every type name in a signature is a variable. In the definition being
+// checked they are rigid, so distinct names are distinct types; in the words
+// it calls they are instantiated afresh for every call.
+class checker {
+public:
+  explicit checker(const flat_ast &ast);
+
+  // Checks every definition, spreading the work over the given pool, and
+  // appends diagnostics to diags in the order the definitions appear: one
+  // for a definition of a name that's already defined, one for each word a
+  // body calls that isn't defined, or else one for a body that doesn't have
+  // its declared type. Returns whether all of them passed.
+  bool check(thread_pool &pool, std::vector<parser::diagnostic> &diags);
+
+  // Only reports definitions of names that are already defined, which unlike
+  // the rest doesn't need every definition to have parsed. Returns whether
+  // there were none.
+  bool check_duplicates(std::vector<parser::diagnostic> &diags);
+
+private:
+  checker(const checker&) = delete;
+  checker& operator=(const checker&) = delete;
+
+  // A word's stack effect, with its type variables numbered from zero in the
+  // order they first appear.
+  struct signature {
+    signature() : num_vars(0) { }
+
+    uint32_t              num_vars;
+    std::vector<uint32_t> inp, out;
+    // The number of types in each of the input's compounds.
+    std::vector<uint32_t> shape;
+    // The names of the variables, for diagnostics.
+    std::vector<symbol>   names;
+  };
+
+  static signature resolve(ast_type_fn type);
+
+  // Adds the primitive words, unless the module defines a word of the same
+  // name itself.
+  void add_builtins();
+
+  // Checks one definition. Returns an empty string if it passes, the reason
+  // it doesn't otherwise.
+  std::string check_def(ast_def def, const signature &sig) const;
+
+  const flat_ast         &ast_;
+  // The resolved signature of every definition, in definition order, and of
+  // every primitive.
+  std::vector<signature>  sigs_, builtins_;
+  // The signature of the word named by each symbol, if there is one. Every
+  // signature is resolved once, up front, so looking one up during a check
+  // is an index.
+  std::vector<const signature*> words_;
+};
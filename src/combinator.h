@@ -0,0 +1,93 @@
+#pragma once
+
+#include "debug.h"
+#include "parser.h"
+#include "stats.h"
+#include "stream.h"
+
+// Parser combinators. Every combinator and literal is its own stateless type,
+// so a grammar written with them is a single static type the compiler can
+// inline end to end; nothing is type-erased or heap-allocated. A rule is any
+// callable taking a parser& and returning the construct it parsed, if any.
+
+template <typename T>
+parser& operator>>(parser &prs, T run) {
+  // Stop parsing if the stream is invalid.
+  if (!prs)
+    return prs;
+
+  stream& s = prs.get_stream();
+  stream::location before = s.get_loc();
+
+  construct *c = run(prs);
+  if (prs && before != s.get_loc())
+    // Clear all the errors located before whatever we just parsed.
+    prs.clear_errors(s.get_loc());
+  if (c)
+    prs.add_construct(c);
+  return prs;
+}
+
+// Matches the character C.
+template<char C>
+constexpr auto parse_char = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_char: " << C << "\n");
+  parse_stats::count(prs.get_stats(), parse_stats::rule::CHAR);
+  stream &s = prs.get_stream();
+  char peek = s.peek();
+  if (peek == C) {
+    s.next();
+  } else {
+    prs.add_error(parser::char_token(C));
+    prs.set_valid(false);
+  }
+  return nullptr;
+};
+
+// Matches the string made of the characters Cs.
+template<char... Cs>
+constexpr auto parse_string = [](parser &prs) -> construct* {
+  static const char str[] = { Cs..., '\0' };
+  static const parser::token tok = parser::string_token(str);
+  DEBUG(std::cout << "parse_string: " << str << "\n");
+  parse_stats::count(prs.get_stats(), parse_stats::rule::STRING);
+  stream &s = prs.get_stream();
+  const char *ostr = str;
+  while (*ostr && s.peek() == *ostr) { ++ostr; s.next(); }
+  if (*ostr) {
+    prs.add_error(tok);
+    prs.set_valid(false);
+  }
+  return nullptr;
+};
+
+// Runs each rule in sequence, stopping at the first one that fails.
+template<typename... Ts>
+constexpr auto compose(Ts... runs) {
+  return [=](parser &prs) -> construct* {
+    (prs >> ... >> runs);
+    return nullptr;
+  };
+}
+
+// Runs the rule, and if it fails, acts as if it had never been run.
+template<typename T>
+constexpr auto maybe(T run) {
+  return [=](parser &prs) -> construct* {
+    parser::checkpoint cp = prs.mark();
+    if (!(prs >> run))
+      prs.rollback(cp);
+    return nullptr;
+  };
+}
+
+// Runs the rule, and if it fails, backtracks to where it started while keeping
+// its errors around for the diagnostic of a later failure.
+template<typename T>
+bool do_try(parser &prs, T run) {
+  parser::checkpoint cp = prs.mark();
+  if (prs >> run)
+    return true;
+  prs.backtrack(cp);
+  return false;
+}
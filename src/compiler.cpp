@@ -0,0 +1,153 @@
+#include "compiler.h"
+
+#include <algorithm>
+
+namespace {
+
+uint32_t count_inputs(const construct_type_fn *type) {
+  uint32_t n = 0;
+  for (construct_type_compound *c : type->get_inp()->get_list())
+    n += c->get_list().size();
+  return n;
+}
+
+} // end anonymous namespace
+
+std::string compiler::compile_def(const construct_def *def) {
+  const symbol_table &syms = mod_.get_symbols();
+  program::word self = prog_.get_word(def->get_name()->get_sym());
+  uint32_t inputs = count_inputs(def->get_type());
+
+  // A shuffle needs no frame, whether or not it names its arguments.
+  if (const shuffle *s = fuse_ ? shuffles_.lookup(def) : nullptr) {
+    shuffle trimmed = *s;
+    trimmed.trim();
+    trimmed.emit(prog_);
+    prog_.emit(program::op::RET);
+    if (self.outputs > inputs)
+      prog_.set_max_growth(std::max(prog_.get_max_growth(),
+                                    self.outputs - inputs));
+    return std::string();
+  }
+
+  uint32_t depth = inputs, peak = depth;
+
+  // Arguments are popped into a frame on entry.
+  std::vector<symbol> args;
+  for (construct_arg_compound *c : def->get_args()->get_list())
+    for (construct_arg_id *id : c->get_list())
+      args.push_back(id->get_sym());
+  if (!args.empty()) {
+    if (args.size() != inputs)
+      return "arguments don't match the input type";
+    if (args.size() > UINT8_MAX)
+      return "too many arguments";
+    prog_.emit(program::op::ENTER);
+    prog_.emit_u8(args.size());
+    depth = 0;
+  }
+
+  // Consecutive shuffles are run together into one, which is only emitted
+  // once something else comes along.
+  shuffle run;
+  auto flush = [&] {
+    run.trim();
+    run.emit(prog_);
+    run = shuffle();
+  };
+
+  for (construct_word *word : def->get_body()->get_list()) {
+    symbol sym = word->get_sym();
+    std::string_view name = syms.get_name(sym);
+    uint32_t takes, leaves;
+
+    // Arguments shadow words of the same name; a later argument shadows an
+    // earlier one.
+    auto arg = std::find(args.rbegin(), args.rend(), sym);
+    program::word callee = prog_.get_word(sym);
+    const shuffle *s = nullptr;
+    if (arg != args.rend()) {
+      flush();
+      prog_.emit(program::op::LOCAL);
+      prog_.emit_u8(args.rend() - arg - 1);
+      takes = 0;
+      leaves = 1;
+    } else if (callee.entry != UINT32_MAX) {
+      if (!(s = fuse_ ? shuffles_.lookup(sym) : nullptr)) {
+        flush();
+        prog_.emit(program::op::CALL);
+        fixups_.emplace_back(prog_.get_offset(), sym);
+        prog_.emit_u32(0);
+      }
+      takes = callee.inputs;
+      leaves = callee.outputs;
+    } else if ((s = shuffle::find_primitive(name))) {
+      takes = s->get_inputs();
+      leaves = s->get_outputs().size();
+    } else {
+      return "unknown word '" + std::string(name) + "'";
+    }
+
+    if (depth < takes)
+      return "'" + std::string(name) + "' takes " + std::to_string(takes) +
+             " values, but the stack only has " + std::to_string(depth);
+    depth += leaves - takes;
+    peak = std::max(peak, depth);
+
+    if (s && !(fuse_ && run.then(*s))) {
+      flush();
+      run = *s;
+    }
+  }
+  flush();
+
+  if (depth != self.outputs)
+    return "the body leaves " + std::to_string(depth) +
+           " values, but the type declares " + std::to_string(self.outputs);
+  prog_.emit(args.empty() ? program::op::RET : program::op::LEAVE);
+  prog_.set_max_growth(std::max(prog_.get_max_growth(), peak - inputs));
+  return std::string();
+}
+
+bool compiler::compile(std::vector<parser::diagnostic> &diags) {
+  const std::vector<construct_def*> &defs = mod_.get_defs();
+  if (fuse_)
+    shuffles_.analyze(mod_);
+
+  // Every word's arity has to be known before any body is compiled, so
+  // calls can be checked. The entries are only placeholders for now; the
+  // first definition of a name is the one that counts.
+  for (construct_def *def : defs) {
+    symbol sym = def->get_name()->get_sym();
+    if (prog_.get_word(sym).entry != UINT32_MAX)
+      continue;
+    program::word w;
+    w.entry = 0;
+    w.inputs = count_inputs(def->get_type());
+    w.outputs = def->get_type()->get_out()->get_list().size();
+    prog_.set_word(sym, w);
+  }
+
+  bool ok = true;
+  std::vector<bool> placed(mod_.get_symbols().size());
+  for (construct_def *def : defs) {
+    symbol sym = def->get_name()->get_sym();
+    uint32_t entry = prog_.get_offset();
+    std::string err = compile_def(def);
+    if (!err.empty()) {
+      diags.push_back(parser::diagnostic(def->get_loc(), err));
+      ok = false;
+    }
+    if (!placed[sym.get_id()]) {
+      program::word w = prog_.get_word(sym);
+      w.entry = entry;
+      prog_.set_word(sym, w);
+      placed[sym.get_id()] = true;
+    }
+  }
+
+  for (const std::pair<uint32_t, symbol> &fixup : fixups_)
+    prog_.patch_u32(fixup.first, prog_.get_word(fixup.second).entry);
+  fixups_.clear();
+  return ok;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bytecode.h"
+#include "construct.h"
+#include "module.h"
+#include "parser.h"
+#include "shuffle.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compiles the definitions of a module to bytecode. A word in a body names,
+// in order of precedence, one of the definition's arguments, another
+// definition or a stack primitive.
+//
+// Along the way the number of values on the stack is tracked through every
+// body, using the declared arity of every word called, and each body has to
+// leave as many values as its type declares. The VM relies on this to run
+// without checking for underflow.
+//
+// Shuffles are fused: a definition that only rearranges its inputs compiles
+// to one instruction without a frame, and every run of consecutive calls to
+// shuffles and stack primitives in a body is emitted as the one shuffle it
+// adds up to, so "swap drop" is a NIP and "rot rot" a -ROT.
+class compiler {
+public:
+  compiler(const module &mod, program &prog)
+    : mod_(mod), prog_(prog), fuse_(true) { }
+
+  // Turns fusing shuffles off, to compile every word as written.
+  void set_fuse(bool fuse) { fuse_ = fuse; }
+
+  // Compiles every definition, appending a diagnostic to diags for each one
+  // that can't be. Returns whether all of them were compiled.
+  bool compile(std::vector<parser::diagnostic> &diags);
+
+private:
+  compiler(const compiler&) = delete;
+  compiler& operator=(const compiler&) = delete;
+
+  // Compiles one definition. Returns an empty string if it compiled, the
+  // reason it didn't otherwise.
+  std::string compile_def(const construct_def *def);
+
+  const module &mod_;
+  program      &prog_;
+  bool          fuse_;
+  shuffle_table shuffles_;
+  // The CALL operands still to be filled in with their callee's entry.
+  std::vector<std::pair<uint32_t, symbol>> fixups_;
+};
@@ -1,20 +1,21 @@
 #include "construct.h"
 
-std::ostream& operator<<(std::ostream &os, const construct &cons) {
-  cons.print(os);
-  return os;
+void construct_symbol::print(std::ostream &os,
+                             const symbol_table &syms) const {
+  os << "[" << get_ty_str() << ", " << syms.get_name(sym_) << "]";
 }
 
-void construct_string::print(std::ostream &os) const {
-  os << "[" << get_ty_str() << ", " << str_ << "]";
+void construct_def::print(std::ostream &os, const symbol_table &syms) const {
+  os << "[def, ";
+  name_->print(os, syms); os << ", ";
+  type_->print(os, syms); os << ", ";
+  args_->print(os, syms); os << ", ";
+  body_->print(os, syms); os << "]";
 }
 
-void construct_def::print(std::ostream &os) const {
-  os << "[def, " << *name_ << ", " << *type_ << ", " << *args_
-     << ", " << *body_ << "]";
+void construct_type_fn::print(std::ostream &os,
+                              const symbol_table &syms) const {
+  os << "[type_fn, ";
+  inp_->print(os, syms); os << ", ";
+  out_->print(os, syms); os << "]";
 }
-
-void construct_type_fn::print(std::ostream &os) const {
-  os << "[type_fn, " << *inp_ << ", " << *out_ << "]";
-}
-
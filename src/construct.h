@@ -1,9 +1,10 @@
 #pragma once
 
-#include <functional>
+#include "stream.h"
+#include "symbol.h"
+
+#include <cstddef>
 #include <ostream>
-#include <string>
-#include <vector>
 
 class construct {
 protected:
@@ -18,57 +19,83 @@ protected:
 public:
   static bool classof(const construct*) { return true; }
 
-  friend std::ostream& operator<<(std::ostream &os, const construct &cons);
-
   type get_ty() const { return ty_; }
 
-private:
-  virtual void print(std::ostream &os) const = 0;
+  // Prints the construct, looking its names up in the given symbol table.
+  virtual void print(std::ostream &os, const symbol_table &syms) const = 0;
 
+private:
   type ty_;
 };
 
+// A view of a list of constructs. The elements live in the same arena as the
+// constructs themselves, so the view is just a pair of pointers.
+template<typename T>
+class construct_list {
+public:
+  typedef T *const *iterator;
+
+  construct_list() : begin_(nullptr), end_(nullptr) { }
+  construct_list(iterator begin, iterator end) : begin_(begin), end_(end) { }
+
+  iterator begin() const { return begin_; }
+  iterator end()   const { return end_;   }
+
+  size_t size()  const { return end_ - begin_;  }
+  bool   empty() const { return begin_ == end_; }
+
+  T *operator[](size_t i) const { return begin_[i]; }
+
+private:
+  iterator begin_, end_;
+};
+
 template<typename T>
 class construct_vec : public construct {
 public:
   construct_vec(construct::type ty) : construct(ty) { }
-  construct_vec(construct::type ty, std::vector<T*> list)
+  construct_vec(construct::type ty, construct_list<T> list)
     : construct(ty), list_(list) {
   }
 
-  std::vector<T*> get_list() const { return list_; }
+  construct_list<T> get_list() const                 { return list_; }
+  void              set_list(construct_list<T> list) { list_ = list; }
+
+  virtual void print(std::ostream &os, const symbol_table &syms) const {
+    os << "[" << get_ty_str();
+    for (auto it = list_.begin(), e = list_.end(); it != e; ++it) {
+      os << ", ";
+      (*it)->print(os, syms);
+    }
+    os << "]";
+  }
 
 private:
   virtual const char *get_ty_str() const = 0;
 
-  virtual void print(std::ostream &os) const {
-    os << "[" << get_ty_str() << ", ";
-    for (auto it = list_.begin(), e = list_.end(); it != e; ++it)
-      os << **it << (std::next(it) != e ? ", " : "]");
-  }
-
-  std::vector<T*> list_;
+  construct_list<T> list_;
 };
 
-class construct_string : public construct {
+class construct_symbol : public construct {
 public:
-  construct_string(construct::type ty, std::string str)
-    : construct(ty), str_(str) {
+  construct_symbol(construct::type ty, symbol sym)
+    : construct(ty), sym_(sym) {
   }
 
-  std::string get_str() const { return str_; }
+  symbol get_sym() const    { return sym_; }
+  void   set_sym(symbol sym) { sym_ = sym;  }
+
+  virtual void print(std::ostream &os, const symbol_table &syms) const;
 
 private:
   virtual const char *get_ty_str() const = 0;
 
-  virtual void print(std::ostream &os) const;
-
-  std::string str_;
+  symbol sym_;
 };
 
-class construct_id : public construct_string {
+class construct_id : public construct_symbol {
 public:
-  construct_id(std::string str) : construct_string(type::ID, str) { }
+  construct_id(symbol sym) : construct_symbol(type::ID, sym) { }
 
   static bool classof(const construct *c) {
     return c->get_ty() == type::ID;
@@ -78,9 +105,9 @@ private:
   virtual const char *get_ty_str() const { return "id"; }
 };
 
-class construct_word : public construct_string {
+class construct_word : public construct_symbol {
 public:
-  construct_word(std::string str) : construct_string(type::WORD, str) { }
+  construct_word(symbol sym) : construct_symbol(type::WORD, sym) { }
 
   static bool classof(const construct *c) {
     return c->get_ty() == type::WORD;
@@ -93,7 +120,7 @@ private:
 class construct_body : public construct_vec<construct_word> {
 public:
   construct_body() : construct_vec(type::BODY) { }
-  construct_body(std::vector<construct_word*> list)
+  construct_body(construct_list<construct_word> list)
     : construct_vec(type::BODY, list) {
   }
 
@@ -105,11 +132,9 @@ private:
   virtual const char *get_ty_str() const { return "body"; }
 };
 
-class construct_type_id : public construct_string {
+class construct_type_id : public construct_symbol {
 public:
-  construct_type_id(std::string str)
-    : construct_string(type::TYPE_ID, str) {
-  }
+  construct_type_id(symbol sym) : construct_symbol(type::TYPE_ID, sym) { }
 
   static bool classof(const construct *c) {
     return c->get_ty() == type::TYPE_ID;
@@ -123,7 +148,7 @@ class construct_type_compound
   : public construct_vec<construct_type_id> {
 public:
   construct_type_compound() : construct_vec(type::TYPE_COMPOUND) { }
-  construct_type_compound(std::vector<construct_type_id*> list)
+  construct_type_compound(construct_list<construct_type_id> list)
     : construct_vec(type::TYPE_COMPOUND, list) {
   }
 
@@ -139,7 +164,7 @@ class construct_type_list
   : public construct_vec<construct_type_compound> {
 public:
   construct_type_list() : construct_vec(type::TYPE_LIST) { }
-  construct_type_list(std::vector<construct_type_compound*> list)
+  construct_type_list(construct_list<construct_type_compound> list)
     : construct_vec(type::TYPE_LIST, list) {
   }
 
@@ -164,16 +189,16 @@ public:
   construct_type_list     *get_inp() const { return inp_; }
   construct_type_compound *get_out() const { return out_; }
 
-private:
-  virtual void print(std::ostream &os) const;
+  virtual void print(std::ostream &os, const symbol_table &syms) const;
 
+private:
   construct_type_list     *inp_;
   construct_type_compound *out_;
 };
 
-class construct_arg_id : public construct_string {
+class construct_arg_id : public construct_symbol {
 public:
-  construct_arg_id(std::string str) : construct_string(type::ARG_ID, str) { }
+  construct_arg_id(symbol sym) : construct_symbol(type::ARG_ID, sym) { }
 
   static bool classof(const construct *c) {
     return c->get_ty() == type::ARG_ID;
@@ -187,7 +212,7 @@ class construct_arg_compound
   : public construct_vec<construct_arg_id> {
 public:
   construct_arg_compound() : construct_vec(type::ARG_COMPOUND) { }
-  construct_arg_compound(std::vector<construct_arg_id*> list)
+  construct_arg_compound(construct_list<construct_arg_id> list)
     : construct_vec(type::ARG_COMPOUND, list) {
   }
 
@@ -203,7 +228,7 @@ class construct_arg_list
   : public construct_vec<construct_arg_compound> {
 public:
   construct_arg_list() : construct_vec(type::ARG_LIST) { }
-  construct_arg_list(std::vector<construct_arg_compound*> list)
+  construct_arg_list(construct_list<construct_arg_compound> list)
     : construct_vec(type::ARG_LIST, list) {
   }
 
@@ -218,9 +243,10 @@ private:
 class construct_def : public construct {
 public:
   construct_def(construct_word *name, construct_type_fn *type,
-                construct_arg_list *args, construct_body *body)
+                construct_arg_list *args, construct_body *body,
+                stream::location loc)
     : construct(type::DEF), name_(name), type_(type),
-      args_(args), body_(body) {
+      args_(args), body_(body), loc_(loc) {
   }
 
   static bool classof(const construct *c) {
@@ -231,13 +257,16 @@ public:
   construct_type_fn  *get_type() const { return type_; }
   construct_arg_list *get_args() const { return args_; }
   construct_body     *get_body() const { return body_; }
+  // Where the definition starts in the source.
+  stream::location    get_loc()  const { return loc_;  }
 
-private:
-  virtual void print(std::ostream &os) const;
+  virtual void print(std::ostream &os, const symbol_table &syms) const;
 
+private:
   construct_word     *name_;
   construct_type_fn  *type_;
   construct_arg_list *args_;
   construct_body     *body_;
+  stream::location    loc_;
 };
 
@@ -0,0 +1,8 @@
+#pragma once
+
+#ifdef __DEBUG__
+#include <iostream>
+#define DEBUG(X) X
+#else
+#define DEBUG(X)
+#endif
@@ -0,0 +1,94 @@
+#include "defindex.h"
+
+#include <algorithm>
+
+const uint32_t def_index::none;
+
+namespace {
+
+// FNV-1a, which is plenty for names of a few bytes.
+uint32_t hash_name(std::string_view name) {
+  uint32_t h = 0x811c9dc5u;
+  for (char c : name)
+    h = (h ^ static_cast<unsigned char>(c)) * 0x01000193u;
+  return h;
+}
+
+} // end anonymous namespace
+
+template<typename F>
+size_t def_index::find(uint32_t hash, F same) const {
+  size_t mask = table_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const entry &e = table_[i];
+    if (e.def == none || (e.hash == hash && same(e)))
+      return i;
+  }
+}
+
+def_index::def_index(const flat_ast &ast) : ast_(ast) {
+  const symbol_table &syms = ast.get_symbols();
+  size_t num_defs = ast.get_num_defs();
+  size_t size = 16;
+  while (size < num_defs * 2)
+    size *= 2;
+  table_.resize(size);
+
+  // The words of every body and what each one calls, which is only known
+  // once every name is in the table.
+  std::vector<call_site> words;
+  std::vector<symbol> args;
+  for (uint32_t i = 0; i != num_defs; ++i) {
+    ast_def def = ast.get_def(i);
+    symbol name = def.get_name().get_sym();
+    uint32_t hash = hash_name(syms.get_name(name));
+    entry &e = table_[find(hash, [name](const entry &e) {
+      return e.sym == name;
+    })];
+    if (e.def != none) {
+      dups_.push_back(i);
+    } else {
+      e.hash = hash;
+      e.def = i;
+      e.sym = name;
+    }
+
+    args.clear();
+    for (ast_arg_compound c : def.get_args())
+      for (ast_arg_id id : c)
+        args.push_back(id.get_sym());
+    for (ast_word word : def.get_body())
+      if (std::find(args.begin(), args.end(), word.get_sym()) == args.end())
+        words.push_back(call_site{ i, word.get_index() });
+  }
+
+  // Bucket the call sites by callee, keeping them in order within each.
+  std::vector<uint32_t> callees(words.size());
+  site_start_.assign(num_defs + 1, 0);
+  for (size_t i = 0, e = words.size(); i != e; ++i) {
+    callees[i] = lookup(ast.get_sym(words[i].node));
+    if (callees[i] == none)
+      undefined_.push_back(words[i]);
+    else
+      ++site_start_[callees[i] + 1];
+  }
+  for (size_t i = 0; i != num_defs; ++i)
+    site_start_[i + 1] += site_start_[i];
+  sites_.resize(site_start_[num_defs]);
+  std::vector<uint32_t> next(site_start_.begin(), site_start_.end() - 1);
+  for (size_t i = 0, e = words.size(); i != e; ++i)
+    if (callees[i] != none)
+      sites_[next[callees[i]]++] = words[i];
+}
+
+uint32_t def_index::lookup(std::string_view name) const {
+  const symbol_table &syms = ast_.get_symbols();
+  return table_[find(hash_name(name), [&](const entry &e) {
+    return syms.get_name(e.sym) == name;
+  })].def;
+}
+
+uint32_t def_index::lookup(symbol sym) const {
+  return table_[find(hash_name(ast_.get_symbols().get_name(sym)),
+                     [sym](const entry &e) { return e.sym == sym; })].def;
+}
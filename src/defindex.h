@@ -0,0 +1,69 @@
+#pragma once
+
+#include "flat_ast.h"
+#include "symbol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The definitions of a module indexed by name, and where each one is
+// called from. Everything is found in one walk over a flat_ast: names go
+// into an open-addressed hash table as their definitions are reached, and
+// the words of every body are gathered up and resolved once the table is
+// complete. A word in a body calls the first definition of its name, unless
+// one of the body's arguments has the same name.
+class def_index {
+public:
+  static const uint32_t none = UINT32_MAX;
+
+  // A word in a body: the definition it's in and its node in the tree.
+  struct call_site {
+    uint32_t def, node;
+  };
+
+  explicit def_index(const flat_ast &ast);
+
+  // The first definition of a name, or none.
+  uint32_t lookup(std::string_view name) const;
+  uint32_t lookup(symbol sym) const;
+
+  // The places a definition is called from, in the order they appear.
+  const call_site *callers_begin(uint32_t def) const {
+    return sites_.data() + site_start_[def];
+  }
+  const call_site *callers_end(uint32_t def) const {
+    return sites_.data() + site_start_[def + 1];
+  }
+
+  // The definitions of names that were already defined, in order.
+  const std::vector<uint32_t> &get_duplicates() const { return dups_; }
+
+  // The words that name neither a definition nor an argument, in order.
+  const std::vector<call_site> &get_undefined() const { return undefined_; }
+
+private:
+  def_index(const def_index&) = delete;
+  def_index& operator=(const def_index&) = delete;
+
+  // A slot of the table, empty when def is none. The name's hash is kept to
+  // skip most of the slots that hold other names without comparing them.
+  struct entry {
+    entry() : hash(0), def(none) { }
+
+    uint32_t hash, def;
+    symbol   sym;
+  };
+
+  // Returns the slot holding the name with the given hash that same()
+  // accepts, or the empty slot it would go in.
+  template<typename F>
+  size_t find(uint32_t hash, F same) const;
+
+  const flat_ast         &ast_;
+  std::vector<entry>      table_;
+  std::vector<uint32_t>   dups_;
+  std::vector<uint32_t>   site_start_;
+  std::vector<call_site>  sites_, undefined_;
+};
@@ -0,0 +1,284 @@
+#include "document.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+document::extent document::extent::of(std::string_view text) {
+  unsigned lines = std::count(text.begin(), text.end(), '\n');
+  size_t nl = text.rfind('\n');
+  return extent(text.size(), lines,
+                nl == std::string_view::npos ? text.size() :
+                                               text.size() - nl - 1);
+}
+
+document::document(std::string name, std::string text)
+  : name_(std::move(name)), seed_(2463534242u) {
+  set_text(std::move(text));
+}
+
+void document::set_text(std::string text) {
+  root_.reset();
+  replace(tree(), tree(), std::move(text));
+}
+
+void document::append_text(const segment *t, std::string &text) {
+  if (!t)
+    return;
+  append_text(t->left.get(), text);
+  text += t->text;
+  append_text(t->right.get(), text);
+}
+
+std::string document::get_text() const {
+  std::string text;
+  if (root_)
+    text.reserve(root_->total.bytes);
+  append_text(root_.get(), text);
+  return text;
+}
+
+size_t document::get_num_defs() const {
+  return root_ ? root_->num_defs : 0;
+}
+
+void document::update(segment *t) {
+  t->total = t->size;
+  t->num_diags = t->diags.size();
+  t->num_defs = t->mod.get_defs().size();
+  if (segment *l = t->left.get()) {
+    t->total = l->total + t->total;
+    t->num_diags += l->num_diags;
+    t->num_defs += l->num_defs;
+  }
+  if (segment *r = t->right.get()) {
+    t->total = t->total + r->total;
+    t->num_diags += r->num_diags;
+    t->num_defs += r->num_defs;
+  }
+}
+
+document::tree document::merge(tree l, tree r) {
+  if (!l)
+    return r;
+  if (!r)
+    return l;
+  if (l->priority < r->priority) {
+    l->right = merge(std::move(l->right), std::move(r));
+    update(l.get());
+    return l;
+  }
+  r->left = merge(std::move(l), std::move(r->left));
+  update(r.get());
+  return r;
+}
+
+void document::split(tree t, size_t offset, bool at, tree &l, tree &r) {
+  if (!t) {
+    l.reset();
+    r.reset();
+    return;
+  }
+
+  size_t begin = t->left ? t->left->total.bytes : 0;
+  size_t end = begin + t->size.bytes;
+  if (at ? begin > offset : end >= offset) {
+    split(std::move(t->left), offset, at, l, t->left);
+    update(t.get());
+    r = std::move(t);
+    return;
+  }
+
+  // Everything after t starts at or after its end.
+  if (at && offset < end)
+    r = std::move(t->right);
+  else
+    split(std::move(t->right), offset - end, at, t->right, r);
+  update(t.get());
+  l = std::move(t);
+}
+
+document::tree document::pop_front(tree &t) {
+  if (!t)
+    return tree();
+  if (t->left) {
+    tree front = pop_front(t->left);
+    update(t.get());
+    return front;
+  }
+  tree front = std::move(t);
+  t = std::move(front->right);
+  return front;
+}
+
+size_t document::get_line_start(unsigned line) const {
+  unsigned breaks = line ? line - 1 : 0;
+  if (!breaks)
+    return 0;
+  if (!root_ || breaks > root_->total.lines)
+    return root_ ? root_->total.bytes : 0;
+
+  // Find the segment holding the line break before the line.
+  size_t base = 0;
+  for (const segment *t = root_.get();;) {
+    const segment *l = t->left.get();
+    if (l && breaks <= l->total.lines) {
+      t = l;
+      continue;
+    }
+    if (l) {
+      breaks -= l->total.lines;
+      base += l->total.bytes;
+    }
+    if (breaks <= t->size.lines) {
+      const char *text = t->text.data(), *p = text;
+      const char *end = text + t->text.size();
+      for (; breaks; --breaks)
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p)) + 1;
+      return base + (p - text);
+    }
+    breaks -= t->size.lines;
+    base += t->size.bytes;
+    t = t->right.get();
+  }
+}
+
+size_t document::get_offset(position pos) const {
+  size_t bytes = root_ ? root_->total.bytes : 0;
+  unsigned lines = root_ ? root_->total.lines : 0;
+  if (pos.line > lines + 1)
+    return bytes;
+
+  // The column can't take us past the line's end.
+  size_t begin = get_line_start(pos.line);
+  size_t end = pos.line <= lines ? get_line_start(pos.line + 1) - 1 : bytes;
+  return std::min(begin + std::max(pos.col, 1u) - 1, end);
+}
+
+void document::edit(position begin, position end, std::string_view text) {
+  size_t b = get_offset(begin), e = std::max(b, get_offset(end));
+
+  // The edit touches every segment that it overlaps or that ends where it
+  // starts or starts where it ends, since those may now run together.
+  tree left, mid, right;
+  split(std::move(root_), b, false, left, mid);
+  size_t base = left ? left->total.bytes : 0;
+  split(std::move(mid), e - base, true, mid, right);
+
+  std::string region;
+  append_text(mid.get(), region);
+  region.replace(b - base, e - b, text);
+  replace(std::move(left), std::move(right), std::move(region));
+}
+
+bool document::parse(segment &seg, std::string text) const {
+  seg.size = extent::of(text);
+  seg.mod = module();
+  seg.diags.clear();
+
+  parser prs(stream(name_.c_str(), text));
+  prs.set_diagnostics(seg.diags);
+  bool clean = prs.parse_piece(seg.mod);
+
+  // Measure the text before each diagnostic, going on from the last one
+  // when they're in order.
+  seg.diag_at.clear();
+  size_t last = 0;
+  extent at;
+  for (const parser::diagnostic &d : seg.diags) {
+    size_t offset = std::min<size_t>(d.loc.get_offset(), text.size());
+    if (offset < last) {
+      last = 0;
+      at = extent();
+    }
+    at = at + extent::of(std::string_view(text).substr(last, offset - last));
+    last = offset;
+    seg.diag_at.push_back(at);
+  }
+
+  seg.text = std::move(text);
+  return clean;
+}
+
+uint32_t document::next_priority() {
+  // xorshift32.
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  return seed_;
+}
+
+void document::replace(tree left, tree right, std::string text) {
+  tree mid;
+  const char *begin = text.data(), *end = begin + text.size(), *p = begin;
+  while (p != end) {
+    const char *q = parser::find_def_end(p, end);
+    std::string piece(p, q);
+    p = q;
+
+    // Until the parse stands on its own, keep adding the text that follows,
+    // first from the edit and then from the segments after it.
+    tree seg(new segment);
+    while (!parse(*seg, piece)) {
+      if (p != end) {
+        q = parser::find_def_end(p, end);
+        piece.append(p, q);
+        p = q;
+      } else if (tree next = pop_front(right)) {
+        piece += next->text;
+      } else {
+        break;
+      }
+    }
+    seg->priority = next_priority();
+    update(seg.get());
+    mid = merge(std::move(mid), std::move(seg));
+  }
+
+  root_ = merge(merge(std::move(left), std::move(mid)), std::move(right));
+}
+
+void document::get_diagnostics(const segment *t, extent before,
+                               std::vector<diagnostic> &diags) {
+  if (!t || !t->num_diags)
+    return;
+  get_diagnostics(t->left.get(), before, diags);
+  if (t->left)
+    before = before + t->left->total;
+  for (size_t i = 0, e = t->diags.size(); i != e; ++i) {
+    extent at = before + t->diag_at[i];
+    diags.push_back(diagnostic(position(at.lines + 1, at.tail + 1),
+                               t->diags[i].message));
+  }
+  get_diagnostics(t->right.get(), before + t->size, diags);
+}
+
+void document::get_diagnostics(std::vector<diagnostic> &diags) const {
+  get_diagnostics(root_.get(), extent(), diags);
+}
+
+document::position document::get_position(stream::location loc) const {
+  // Add up the size of the text before loc, down to the segment holding it.
+  size_t offset = loc.get_offset();
+  extent before;
+  for (const segment *t = root_.get(); t;) {
+    const segment *l = t->left.get();
+    if (l && offset < l->total.bytes) {
+      t = l;
+      continue;
+    }
+    if (l) {
+      before = before + l->total;
+      offset -= l->total.bytes;
+    }
+    if (offset < t->size.bytes) {
+      before = before +
+        extent::of(std::string_view(t->text).substr(0, offset));
+      break;
+    }
+    before = before + t->size;
+    offset -= t->size.bytes;
+    t = t->right.get();
+  }
+  return position(before.lines + 1, before.tail + 1);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "module.h"
+#include "parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A source file kept parsed in memory while it is being edited. The text is
+// held as a run of segments that each end where a definition ends, and each
+// segment is parsed on its own into its own module. An edit only re-parses
+// the segments it touches, and the segments after it when error recovery
+// needs them, so its cost follows the size of the edit rather than the file.
+//
+// The segments are the nodes of a balanced tree that keeps the size of the
+// text under every node, so finding the segment an offset or a line is in
+// takes time logarithmic in the number of segments.
+class document {
+public:
+  // A position in the text. Lines and columns count from one, like those of
+  // stream::position, and columns count bytes.
+  struct position {
+    position(unsigned line, unsigned col) : line(line), col(col) { }
+
+    unsigned line, col;
+  };
+
+  // A diagnostic, at the position of the character it was found at.
+  struct diagnostic {
+    diagnostic(position pos, const std::string &message)
+      : pos(pos), message(message) {
+    }
+
+    position    pos;
+    std::string message;
+  };
+
+  document(std::string name, std::string text);
+
+  const std::string &get_name() const { return name_; }
+
+  // Replaces the whole text.
+  void set_text(std::string text);
+
+  // Replaces the text between begin and end. Positions past the end of a line
+  // or of the text are taken to mean the end of it.
+  void edit(position begin, position end, std::string_view text);
+
+  std::string get_text() const;
+
+  // Appends the diagnostics for the whole text to diags, in order. Only the
+  // segments that have diagnostics are visited.
+  void get_diagnostics(std::vector<diagnostic> &diags) const;
+
+  // Returns the position of a location in the text.
+  position get_position(stream::location loc) const;
+
+  size_t get_num_defs() const;
+
+private:
+  // The size of a run of text: its bytes, its line breaks, and the bytes
+  // after the last one, or all of them if there are none. Sizes of runs
+  // that follow each other add up with +, which isn't commutative.
+  struct extent {
+    extent() : bytes(0), lines(0), tail(0) { }
+    extent(size_t bytes, unsigned lines, size_t tail)
+      : bytes(bytes), lines(lines), tail(tail) {
+    }
+
+    // Measures text.
+    static extent of(std::string_view text);
+
+    extent operator+(const extent &r) const {
+      return extent(bytes + r.bytes, lines + r.lines,
+                    r.lines ? r.tail : tail + r.bytes);
+    }
+
+    size_t   bytes;
+    unsigned lines;
+    size_t   tail;
+  };
+
+  struct segment;
+  typedef std::unique_ptr<segment> tree;
+
+  struct segment {
+    segment() : priority(0), num_diags(0), num_defs(0) { }
+
+    std::string                     text;
+    extent                          size;
+    module                          mod;
+    // The diagnostics, with their locations relative to the start of the
+    // segment, and the size of the text before each one, which gives its
+    // position once the position of the segment is known.
+    std::vector<parser::diagnostic> diags;
+    std::vector<extent>             diag_at;
+
+    // The segments before and after this one, a random priority no greater
+    // than theirs, and what the segments under this one hold in all.
+    tree     left, right;
+    uint32_t priority;
+    extent   total;
+    size_t   num_diags, num_defs;
+  };
+
+  // Recomputes the totals of t from its own and its children's.
+  static void update(segment *t);
+
+  // Joins the segments of l and r, in that order.
+  static tree merge(tree l, tree r);
+
+  // Splits t into the segments that end before offset, and the rest. With
+  // at set, it splits into the segments that start at or before offset, and
+  // the rest, instead.
+  static void split(tree t, size_t offset, bool at, tree &l, tree &r);
+
+  // Removes the first segment of t and returns it, or null if t is empty.
+  static tree pop_front(tree &t);
+
+  static void append_text(const segment *t, std::string &text);
+  // Appends the diagnostics under t, which starts after a run of text the
+  // size of before.
+  static void get_diagnostics(const segment *t, extent before,
+                              std::vector<diagnostic> &diags);
+
+  // Returns the offset the line starts at, or the size of the text if there
+  // aren't that many lines.
+  size_t get_line_start(unsigned line) const;
+
+  // Returns the offset of the given position in the text.
+  size_t get_offset(position pos) const;
+
+  // Makes the segments between left and right, which were split off from
+  // the tree and are all that's left of it, out of text.
+  void replace(tree left, tree right, std::string text);
+
+  // Parses text into seg. Returns whether the parse stands on its own.
+  bool parse(segment &seg, std::string text) const;
+
+  uint32_t next_priority();
+
+  std::string name_;
+  tree        root_;
+  // The state of the generator of priorities, which are random but the
+  // same from run to run.
+  uint32_t    seed_;
+};
@@ -0,0 +1,364 @@
+#include "driver.h"
+#include "cache.h"
+#include "check.h"
+#include "flat_ast.h"
+#include "inliner.h"
+#include "module.h"
+#include "parser.h"
+#include "prune.h"
+#include "server.h"
+#include "stats.h"
+#include "stream.h"
+#include "stream_parser.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+void driver::show_usage(std::ostream &os) const {
+  os << prog_ << " [-j <jobs>] [--cache-dir=<dir>] [--entry=<word>...]"
+     << " [--check]\n"
+     << std::string(prog_.size() + 1, ' ')
+     << "[--inline[-callee=<words>|-body=<words>]] [--stream] [--stats]\n"
+     << std::string(prog_.size() + 1, ' ')
+     << "[--packrat] [--dump-ast=json|bin]\n"
+     << std::string(prog_.size() + 1, ' ')
+     << "<input file>|-... [@<response file>]\n"
+     << prog_ << " --serve" << std::endl;
+}
+
+bool driver::read_response_file(const std::string &filename,
+                                std::vector<std::string> &args) {
+  std::ifstream input(filename);
+  if (!input) {
+    std::cerr << "Could not open response file: " << filename << std::endl;
+    return false;
+  }
+  for (std::string arg; input >> arg;)
+    args.push_back(arg);
+  return true;
+}
+
+// Reads a count, accepting only positive numbers.
+static bool parse_count(const std::string &str, unsigned &count) {
+  char *end;
+  long n = std::strtol(str.c_str(), &end, 10);
+  if (str.empty() || *end || n <= 0)
+    return false;
+  count = n;
+  return true;
+}
+
+bool driver::add_arg(const std::string &arg, std::vector<std::string> &rest) {
+  if (arg.size() > 1 && arg[0] == '@') {
+    std::vector<std::string> args;
+    if (!read_response_file(arg.substr(1), args))
+      return false;
+    rest.insert(rest.begin(), args.begin(), args.end());
+    return true;
+  }
+
+  if (arg == "-j") {
+    if (rest.empty() || !parse_count(rest.front(), jobs_))
+      return false;
+    rest.erase(rest.begin());
+    return true;
+  }
+  if (arg.compare(0, 2, "-j") == 0)
+    return parse_count(arg.substr(2), jobs_);
+  if (arg.compare(0, 7, "--jobs=") == 0)
+    return parse_count(arg.substr(7), jobs_);
+
+  if (arg == "--cache-dir") {
+    if (rest.empty())
+      return false;
+    cache_dir_ = rest.front();
+    rest.erase(rest.begin());
+    return true;
+  }
+  if (arg.compare(0, 12, "--cache-dir=") == 0) {
+    cache_dir_ = arg.substr(12);
+    return !cache_dir_.empty();
+  }
+
+  if (arg.compare(0, 8, "--entry=") == 0) {
+    entries_.push_back(arg.substr(8));
+    return !entries_.back().empty();
+  }
+
+  if (arg == "--check") {
+    check_ = true;
+    return true;
+  }
+
+  if (arg == "--inline") {
+    inline_ = true;
+    return true;
+  }
+  if (arg.compare(0, 16, "--inline-callee=") == 0) {
+    inline_ = true;
+    return parse_count(arg.substr(16), inline_callee_);
+  }
+  if (arg.compare(0, 14, "--inline-body=") == 0) {
+    inline_ = true;
+    return parse_count(arg.substr(14), inline_body_);
+  }
+
+  if (arg == "--stream") {
+    stream_ = true;
+    return true;
+  }
+
+  if (arg == "--stats") {
+    stats_ = true;
+    return true;
+  }
+
+  if (arg == "--packrat") {
+    packrat_ = true;
+    return true;
+  }
+
+  if (arg.compare(0, 11, "--dump-ast=") == 0) {
+    dump_ = true;
+    if (arg.substr(11) == "json")
+      dump_format_ = ast_dumper::format::JSON;
+    else if (arg.substr(11) == "bin")
+      dump_format_ = ast_dumper::format::BIN;
+    else
+      return false;
+    return true;
+  }
+
+  if (arg == "--serve") {
+    serve_ = true;
+    return true;
+  }
+
+  if (arg.size() > 1 && arg[0] == '-') {
+    std::cerr << "Unknown option: " << arg << std::endl;
+    return false;
+  }
+  inputs_.push_back(arg);
+  return true;
+}
+
+bool driver::parse_args(int argc, char *argv[]) {
+  prog_ = argv[0];
+  std::vector<std::string> rest(argv + 1, argv + argc);
+  while (!rest.empty()) {
+    std::string arg = rest.front();
+    rest.erase(rest.begin());
+    if (!add_arg(arg, rest))
+      return false;
+  }
+  if (stream_ && (check_ || inline_ || dump_ || !cache_dir_.empty() ||
+                  !entries_.empty())) {
+    std::cerr << "--stream can't be combined with --check, --inline,"
+              << " --dump-ast, --cache-dir or --entry" << std::endl;
+    return false;
+  }
+  return serve_ ? inputs_.empty() : !inputs_.empty();
+}
+
+// Reads all of standard input.
+static std::string read_stdin() {
+  std::ostringstream text;
+  text << std::cin.rdbuf();
+  return text.str();
+}
+
+bool driver::process(const std::string &filename, std::ostream &os,
+                     std::ostream &out, thread_pool &pool, bool parallel) {
+  if (stream_)
+    return process_stream(filename, os);
+
+  bool from_stdin = filename == "-";
+  stream s = from_stdin ? stream("<stdin>", read_stdin()) :
+                          stream(filename.c_str());
+  if (!from_stdin && s.is_valid()) {
+    if (inputs_.size() == 1)
+      show_usage(os);
+    os << "Could not open file: " << filename << std::endl;
+    return false;
+  }
+
+  parser p(s);
+  p.set_diagnostics(os);
+  parse_stats stats;
+  if (stats_)
+    p.set_stats(&stats);
+  p.set_packrat(packrat_);
+  module m;
+
+  // Only modules without errors are cached, so a hit has nothing to report
+  // and only needs reading in if it's going to be pruned, checked, inlined or
+  // dumped.
+  ast_cache cache(cache_dir_);
+  ast_cache::key key;
+  bool cached = false;
+  if (!cache_dir_.empty()) {
+    key = ast_cache::get_key(s.get_text());
+    ast_cache::image img = cache.lookup(key);
+    if (img.is_valid() && entries_.empty() && !check_ && !inline_ && !dump_)
+      return true;
+    cached = img.is_valid() && img.read(m);
+    if (!cached)
+      m = module();
+  }
+
+  if (!cached) {
+    m = parallel ? p.parse(pool) : p.parse();
+    if (!cache_dir_.empty() && m.is_valid())
+      cache.store(key, m);
+  }
+  if (stats_ && !cached) {
+    os << s.get_filename() << ": parse stats\n";
+    stats.report(os);
+  }
+  if (!m.is_valid()) {
+    // Which words are undefined or mistyped isn't known with definitions
+    // missing, but names defined twice still are.
+    if (check_) {
+      std::vector<parser::diagnostic> diags;
+      flat_ast ast(m);
+      checker(ast).check_duplicates(diags);
+      for (const parser::diagnostic &d : diags)
+        p.report(d.loc, d.message);
+    }
+    return false;
+  }
+
+  if (!entries_.empty()) {
+    pruner prn(m);
+    for (const std::string &entry : entries_)
+      prn.add_entry(entry);
+    if (!prn.run(pool)) {
+      for (const std::string &entry : prn.get_missing())
+        os << filename << ": no definition of entry word '" << entry << "'\n";
+      return false;
+    }
+    os << filename << ": ";
+    prn.report(os);
+  }
+
+  bool ok = true;
+  if (check_) {
+    std::vector<parser::diagnostic> diags;
+    flat_ast ast(m);
+    checker c(ast);
+    ok = c.check(pool, diags);
+    for (const parser::diagnostic &d : diags)
+      p.report(d.loc, d.message);
+  }
+
+  if (inline_) {
+    inliner inl(m);
+    if (inline_callee_)
+      inl.set_max_callee(inline_callee_);
+    if (inline_body_)
+      inl.set_max_body(inline_body_);
+    inl.run(pool);
+    os << filename << ": ";
+    inl.report(os);
+  }
+
+  if (dump_) {
+    ast_dumper dumper(dump_format_, out);
+    if (!dumper.dump(m, s)) {
+      os << filename << ": too big to dump" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool driver::process_stream(const std::string &filename, std::ostream &os) {
+  bool from_stdin = filename == "-";
+  int fd = from_stdin ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (inputs_.size() == 1)
+      show_usage(os);
+    os << "Could not open file: " << filename << std::endl;
+    return false;
+  }
+
+  stream_parser sp(from_stdin ? "<stdin>" : filename.c_str(), fd);
+  sp.set_diagnostics(os);
+  parse_stats stats;
+  if (stats_)
+    sp.set_stats(&stats);
+  sp.set_packrat(packrat_);
+  // Nothing needs the definitions once they've parsed.
+  bool ok = sp.parse([](module&) { });
+  if (!from_stdin)
+    close(fd);
+  if (sp.has_failed())
+    os << "Could not read file: " << filename << std::endl;
+  if (stats_) {
+    os << (from_stdin ? "<stdin>" : filename) << ": parse stats\n";
+    stats.report(os);
+  }
+  return ok;
+}
+
+int driver::run() {
+  if (serve_) {
+    std::ios::sync_with_stdio(false);
+    server srv(std::cin, std::cout);
+    return srv.run();
+  }
+
+  int status = process_all();
+  if (stats_)
+    report_peak_rss(std::cerr);
+  return status;
+}
+
+int driver::process_all() {
+  // A single input gets the worker threads to itself.
+  thread_pool pool(jobs_);
+  if (inputs_.size() == 1)
+    return process(inputs_.front(), std::cerr, std::cout, pool,
+                   jobs_ != 1) ? 0 : 1;
+
+  struct result {
+    result() : done(false), ok(false) { }
+
+    std::string diags, dump;
+    bool        done, ok;
+  };
+  std::vector<result> results(inputs_.size());
+  size_t printed = 0;
+  bool ok = true;
+  std::mutex mutex;
+
+  pool.parallel_for(inputs_.size(), [&](size_t i) {
+    std::ostringstream os, out;
+    bool file_ok = process(inputs_[i], os, out, pool, false);
+
+    // Print every finished input that isn't waiting on an earlier one.
+    std::lock_guard<std::mutex> lock(mutex);
+    results[i].diags = os.str();
+    results[i].dump = out.str();
+    results[i].ok = file_ok;
+    results[i].done = true;
+    for (; printed != results.size() && results[printed].done; ++printed) {
+      result &r = results[printed];
+      std::cerr.write(r.diags.data(), r.diags.size());
+      std::cout.write(r.dump.data(), r.dump.size());
+      ok = ok && r.ok;
+      std::string().swap(r.diags);
+      std::string().swap(r.dump);
+    }
+  });
+  std::cerr.flush();
+  std::cout.flush();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "dump.h"
+#include "thread_pool.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs wildcat over the inputs given on the command line, where "-" stands for
+// standard input. Inputs are parsed on a pool of worker threads; each one's
+// diagnostics are buffered and printed whole, in the order the inputs were
+// given.
+class driver {
+public:
+  driver()
+    : jobs_(0), check_(false), inline_(false), inline_callee_(0),
+      inline_body_(0), stream_(false), stats_(false), packrat_(false),
+      dump_(false), dump_format_(ast_dumper::format::JSON), serve_(false) {
+  }
+
+  // Reads the command line. Arguments of the form @file name a response file
+  // holding more arguments, separated by whitespace. Returns false if the
+  // command line is malformed.
+  bool parse_args(int argc, char *argv[]);
+
+  // Processes every input and returns the exit status: 0 if all of them were
+  // processed without errors, 1 otherwise.
+  int run();
+
+  void show_usage(std::ostream &os) const;
+
+private:
+  bool add_arg(const std::string &arg, std::vector<std::string> &rest);
+  bool read_response_file(const std::string &filename,
+                          std::vector<std::string> &args);
+
+  // Processes one input, writing its diagnostics to os and its dump, if
+  // there is one, to out. Work is spread over the pool where possible, and
+  // the parse is split up too if parallel is set. Returns whether the input
+  // was processed without errors.
+  bool process(const std::string &filename, std::ostream &os,
+               std::ostream &out, thread_pool &pool, bool parallel);
+  // Processes every input, returning the exit status like run().
+  int process_all();
+  // Processes one input a window at a time, in bounded memory.
+  bool process_stream(const std::string &filename, std::ostream &os);
+
+  std::string              prog_;
+  std::vector<std::string> inputs_;
+  // The number of worker threads, zero for one per hardware thread.
+  unsigned                 jobs_;
+  // Where parsed modules are cached, empty for no caching.
+  std::string              cache_dir_;
+  // The words to keep, with everything they call, dropping the rest of each
+  // module before anything else is done with it. Empty to keep everything.
+  std::vector<std::string> entries_;
+  // Whether to check the stack effects of definitions.
+  bool                     check_;
+  // Whether to inline small definitions and report on it, and the limits to
+  // do it with, zero for the inliner's own.
+  bool                     inline_;
+  unsigned                 inline_callee_, inline_body_;
+  // Whether to parse inputs as they're read instead of all at once.
+  bool                     stream_;
+  // Whether to report what parsing each input took, and peak memory use.
+  bool                     stats_;
+  // Whether to parse in packrat mode.
+  bool                     packrat_;
+  // Whether to dump the AST of every input to stdout, and in what format.
+  bool                     dump_;
+  ast_dumper::format       dump_format_;
+  // Whether to serve an editor over stdio instead of processing inputs.
+  bool                     serve_;
+};
@@ -0,0 +1,127 @@
+#include "dump.h"
+#include "cache.h"
+#include "json.h"
+
+#include <charconv>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// How much output is buffered before it's written out.
+const size_t flush_size = 1 << 20;
+
+// Formats definitions as JSON. Every name is escaped once up front, so each
+// use of it is a copy.
+class json_writer {
+public:
+  json_writer(const symbol_table &syms, const stream &s, std::string &out)
+    : stream_(s), out_(out) {
+    for (uint32_t i = 0, e = syms.size(); i != e; ++i) {
+      ends_.push_back(names_.size());
+      json::write_string(names_, syms.get_name(symbol(i)));
+    }
+    ends_.push_back(names_.size());
+  }
+
+  void put(char c) { out_.push_back(c); }
+  void put(std::string_view str) { out_.append(str); }
+
+  void put_num(uint64_t n) {
+    char buf[20];
+    out_.append(buf, std::to_chars(buf, buf + sizeof(buf), n).ptr);
+  }
+
+  void put_sym(symbol sym) {
+    uint32_t id = sym.get_id();
+    out_.append(names_.data() + ends_[id], ends_[id + 1] - ends_[id]);
+  }
+
+  template<typename T>
+  void put_compound(const construct_vec<T> *c) {
+    construct_list<T> list = c->get_list();
+    put('[');
+    for (auto it = list.begin(), e = list.end(); it != e; ++it) {
+      if (it != list.begin())
+        put(',');
+      put_sym((*it)->get_sym());
+    }
+    put(']');
+  }
+
+  template<typename T>
+  void put_list(const construct_vec<T> *c) {
+    construct_list<T> list = c->get_list();
+    put('[');
+    for (auto it = list.begin(), e = list.end(); it != e; ++it) {
+      if (it != list.begin())
+        put(',');
+      put_compound(*it);
+    }
+    put(']');
+  }
+
+  void put_def(const construct_def *def) {
+    stream::location loc = def->get_loc();
+    stream::position pos = stream_.get_position(loc);
+    put("{\"name\":");
+    put_sym(def->get_name()->get_sym());
+    put(",\"offset\":");
+    put_num(loc.get_offset());
+    put(",\"line\":");
+    put_num(pos.get_line());
+    put(",\"col\":");
+    put_num(pos.get_col());
+    put(",\"inp\":");
+    put_list(def->get_type()->get_inp());
+    put(",\"out\":");
+    put_compound(def->get_type()->get_out());
+    put(",\"args\":");
+    put_list(def->get_args());
+    put(",\"body\":");
+    put_compound(def->get_body());
+    put('}');
+  }
+
+private:
+  const stream         &stream_;
+  std::string          &out_;
+  // The names, quoted and escaped, and where each one ends.
+  std::string           names_;
+  std::vector<size_t>   ends_;
+};
+
+} // end anonymous namespace
+
+bool ast_dumper::dump(const module &mod, const stream &s) {
+  if (fmt_ == format::JSON) {
+    dump_json(mod, s);
+    return true;
+  }
+  bool ok = ast_cache::make_image(ast_cache::get_key(s.get_text()), mod,
+                                  buf_);
+  flush();
+  return ok;
+}
+
+void ast_dumper::dump_json(const module &mod, const stream &s) {
+  json_writer w(mod.get_symbols(), s, buf_);
+  w.put("{\"file\":");
+  json::write_string(buf_, s.get_filename());
+  w.put(",\"defs\":[");
+  const std::vector<construct_def*> &defs = mod.get_defs();
+  for (size_t i = 0, e = defs.size(); i != e; ++i) {
+    if (i)
+      w.put(',');
+    w.put_def(defs[i]);
+    if (buf_.size() >= flush_size)
+      flush();
+  }
+  w.put("]}\n");
+  flush();
+}
+
+void ast_dumper::flush() {
+  os_.write(buf_.data(), buf_.size());
+  buf_.clear();
+}
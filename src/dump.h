@@ -0,0 +1,43 @@
+#pragma once
+
+#include "module.h"
+#include "stream.h"
+
+#include <ostream>
+#include <string>
+
+// Writes parsed modules out for other tools to read without parsing the
+// sources again. Everything is formatted by hand into one buffer, which is
+// written out whenever it fills up, so a dump costs a few large writes
+// rather than a stream operation per node.
+//
+// A JSON dump is one line per module:
+//
+//   {"file":"a.wc","defs":[{"name":"swap2","offset":0,"line":1,"col":1,
+//    "inp":[["a","b"],["c"]],"out":["c","b","a"],"args":[],"body":[...]}]}
+//
+// A binary dump is the module's image as ast_cache lays it out, so it can be
+// mapped and read in place; images are concatenated, each holding its size.
+class ast_dumper {
+public:
+  enum class format { JSON, BIN };
+
+  ast_dumper(format fmt, std::ostream &os) : fmt_(fmt), os_(os) { }
+
+  // Dumps a module parsed from the given stream's text. Returns false if the
+  // module is too big for the binary format.
+  bool dump(const module &mod, const stream &s);
+
+private:
+  ast_dumper(const ast_dumper&) = delete;
+  ast_dumper& operator=(const ast_dumper&) = delete;
+
+  void dump_json(const module &mod, const stream &s);
+
+  // Writes out the buffer and empties it.
+  void flush();
+
+  format        fmt_;
+  std::ostream &os_;
+  std::string   buf_;
+};
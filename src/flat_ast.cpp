@@ -0,0 +1,82 @@
+#include "flat_ast.h"
+
+namespace {
+
+// The kind of node each construct class becomes.
+template<typename T> struct kind_of;
+
+template<> struct kind_of<construct_word> {
+  static constexpr ast_kind value = ast_kind::WORD;
+};
+template<> struct kind_of<construct_type_id> {
+  static constexpr ast_kind value = ast_kind::TYPE_ID;
+};
+template<> struct kind_of<construct_type_compound> {
+  static constexpr ast_kind value = ast_kind::TYPE_COMPOUND;
+};
+template<> struct kind_of<construct_arg_id> {
+  static constexpr ast_kind value = ast_kind::ARG_ID;
+};
+template<> struct kind_of<construct_arg_compound> {
+  static constexpr ast_kind value = ast_kind::ARG_COMPOUND;
+};
+
+} // end anonymous namespace
+
+flat_ast::flat_ast(const module &mod) : syms_(&mod.get_symbols()) {
+  const std::vector<construct_def*> &defs = mod.get_defs();
+  defs_.reserve(defs.size());
+  locs_.reserve(defs.size());
+  for (const construct_def *def : defs) {
+    uint32_t n = reserve(1);
+    defs_.push_back(n);
+    locs_.push_back(def->get_loc());
+    set(n, def);
+  }
+}
+
+uint32_t flat_ast::reserve(uint32_t count) {
+  uint32_t first = kinds_.size();
+  kinds_.resize(first + count);
+  vals_.resize(first + count);
+  sizes_.resize(first + count);
+  return first;
+}
+
+void flat_ast::set(uint32_t n, const construct_symbol *c, ast_kind k) {
+  kinds_[n] = k;
+  vals_[n] = c->get_sym().get_id();
+  sizes_[n] = 0;
+}
+
+template<typename T>
+void flat_ast::set(uint32_t n, const construct_vec<T> *c, ast_kind k) {
+  construct_list<T> list = c->get_list();
+  // Every child is added before any is filled in, so they are consecutive.
+  uint32_t first = reserve(list.size());
+  kinds_[n] = k;
+  vals_[n] = first;
+  sizes_[n] = list.size();
+  for (uint32_t i = 0, e = list.size(); i != e; ++i)
+    set(first + i, list[i], kind_of<T>::value);
+}
+
+void flat_ast::set(uint32_t n, const construct_type_fn *c) {
+  uint32_t first = reserve(2);
+  kinds_[n] = ast_kind::TYPE_FN;
+  vals_[n] = first;
+  sizes_[n] = 2;
+  set(first, c->get_inp(), ast_kind::TYPE_LIST);
+  set(first + 1, c->get_out(), ast_kind::TYPE_COMPOUND);
+}
+
+void flat_ast::set(uint32_t n, const construct_def *c) {
+  uint32_t first = reserve(4);
+  kinds_[n] = ast_kind::DEF;
+  vals_[n] = first;
+  sizes_[n] = 4;
+  set(first, c->get_name(), ast_kind::WORD);
+  set(first + 1, c->get_type());
+  set(first + 2, c->get_args(), ast_kind::ARG_LIST);
+  set(first + 3, c->get_body(), ast_kind::BODY);
+}
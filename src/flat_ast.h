@@ -0,0 +1,232 @@
+#pragma once
+
+#include "module.h"
+#include "stream.h"
+#include "symbol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class flat_ast;
+
+// The kinds of node in a flat_ast, one per construct class.
+enum class ast_kind : uint8_t {
+  WORD, BODY, DEF,
+  TYPE_ID, TYPE_COMPOUND, TYPE_LIST, TYPE_FN,
+  ARG_ID, ARG_COMPOUND, ARG_LIST
+};
+
+// A handle to a node of a flat_ast: the tree and the node's index. Handles
+// are passed by value and work with isa, cast and dyn_cast from rtti.h like
+// construct pointers do; a failed dyn_cast gives a null handle. The typed
+// handles below add accessors for what their kind of node holds.
+class ast_node {
+public:
+  ast_node() : ast_(nullptr), index_(0) { }
+  ast_node(const flat_ast *ast, uint32_t index) : ast_(ast), index_(index) { }
+
+  static bool classof(const ast_node&) { return true; }
+
+  explicit operator bool() const { return ast_ != nullptr; }
+
+  const flat_ast *get_ast()   const { return ast_;   }
+  uint32_t        get_index() const { return index_; }
+  inline ast_kind get_kind()  const;
+
+protected:
+  const flat_ast *ast_;
+  uint32_t        index_;
+};
+
+// A name: a word, a type name or an argument.
+class ast_symbol : public ast_node {
+public:
+  ast_symbol() { }
+  explicit ast_symbol(ast_node n) : ast_node(n) { }
+
+  static bool classof(const ast_node &n) {
+    ast_kind k = n.get_kind();
+    return k == ast_kind::WORD || k == ast_kind::TYPE_ID ||
+           k == ast_kind::ARG_ID;
+  }
+
+  inline symbol get_sym() const;
+};
+
+template<ast_kind K>
+class ast_leaf : public ast_symbol {
+public:
+  ast_leaf() { }
+  explicit ast_leaf(ast_node n) : ast_symbol(n) { }
+
+  static bool classof(const ast_node &n) { return n.get_kind() == K; }
+};
+
+typedef ast_leaf<ast_kind::WORD>    ast_word;
+typedef ast_leaf<ast_kind::TYPE_ID> ast_type_id;
+typedef ast_leaf<ast_kind::ARG_ID>  ast_arg_id;
+
+// A node whose children are all of type T, which are next to each other in
+// the tree, so iterating over them walks the tree's arrays in order.
+template<typename T, ast_kind K>
+class ast_vec : public ast_node {
+public:
+  class iterator {
+  public:
+    iterator(const flat_ast *ast, uint32_t index)
+      : ast_(ast), index_(index) {
+    }
+
+    T operator*() const { return T(ast_node(ast_, index_)); }
+    iterator &operator++() { ++index_; return *this; }
+    bool operator!=(const iterator &r) const { return index_ != r.index_; }
+    bool operator==(const iterator &r) const { return index_ == r.index_; }
+
+  private:
+    const flat_ast *ast_;
+    uint32_t        index_;
+  };
+
+  ast_vec() { }
+  explicit ast_vec(ast_node n) : ast_node(n) { }
+
+  static bool classof(const ast_node &n) { return n.get_kind() == K; }
+
+  inline iterator begin() const;
+  inline iterator end()   const;
+  inline size_t   size()  const;
+  bool            empty() const { return size() == 0; }
+
+  T operator[](size_t i) const { return *iterator(ast_, first() + i); }
+
+private:
+  inline uint32_t first() const;
+};
+
+typedef ast_vec<ast_word, ast_kind::BODY>                  ast_body;
+typedef ast_vec<ast_type_id, ast_kind::TYPE_COMPOUND>      ast_type_compound;
+typedef ast_vec<ast_type_compound, ast_kind::TYPE_LIST>    ast_type_list;
+typedef ast_vec<ast_arg_id, ast_kind::ARG_COMPOUND>        ast_arg_compound;
+typedef ast_vec<ast_arg_compound, ast_kind::ARG_LIST>      ast_arg_list;
+
+class ast_type_fn : public ast_node {
+public:
+  ast_type_fn() { }
+  explicit ast_type_fn(ast_node n) : ast_node(n) { }
+
+  static bool classof(const ast_node &n) {
+    return n.get_kind() == ast_kind::TYPE_FN;
+  }
+
+  inline ast_type_list     get_inp() const;
+  inline ast_type_compound get_out() const;
+};
+
+class ast_def : public ast_node {
+public:
+  ast_def() { }
+  explicit ast_def(ast_node n) : ast_node(n) { }
+
+  static bool classof(const ast_node &n) {
+    return n.get_kind() == ast_kind::DEF;
+  }
+
+  inline ast_word     get_name() const;
+  inline ast_type_fn  get_type() const;
+  inline ast_arg_list get_args() const;
+  inline ast_body     get_body() const;
+};
+
+// A module's definitions stored as a struct of arrays instead of a tree of
+// constructs. Every node is an index into parallel arrays of kinds and two
+// 32-bit fields: a name's symbol, or the index of a node's first child and
+// the number of children. A node's children are consecutive and each
+// definition's nodes are a contiguous block, so walking the tree in order
+// walks the arrays in order, without chasing pointers.
+class flat_ast {
+public:
+  // Flattens the definitions of mod, whose symbol table the tree goes on
+  // using, so mod has to outlive it.
+  explicit flat_ast(const module &mod);
+
+  const symbol_table &get_symbols() const { return *syms_; }
+
+  size_t  get_num_defs() const { return defs_.size(); }
+  ast_def get_def(size_t i) const { return ast_def(ast_node(this, defs_[i])); }
+  // Where a definition starts in the source.
+  stream::location get_loc(size_t i) const { return locs_[i]; }
+
+  size_t   get_num_nodes()       const { return kinds_.size();    }
+  ast_kind get_kind(uint32_t n)  const { return kinds_[n];        }
+  symbol   get_sym(uint32_t n)   const { return symbol(vals_[n]); }
+  uint32_t get_first(uint32_t n) const { return vals_[n];         }
+  uint32_t get_size(uint32_t n)  const { return sizes_[n];        }
+
+private:
+  flat_ast(const flat_ast&) = delete;
+  flat_ast& operator=(const flat_ast&) = delete;
+
+  // Appends count nodes, returning the index of the first.
+  uint32_t reserve(uint32_t count);
+  // Fills in node n, and the nodes below it.
+  void set(uint32_t n, const construct_symbol *c, ast_kind k);
+  void set(uint32_t n, const construct_type_fn *c);
+  void set(uint32_t n, const construct_def *c);
+  template<typename T>
+  void set(uint32_t n, const construct_vec<T> *c, ast_kind k);
+
+  const symbol_table            *syms_;
+  std::vector<ast_kind>          kinds_;
+  // A name's symbol id, or a node's first child.
+  std::vector<uint32_t>          vals_;
+  // A node's number of children; zero for names.
+  std::vector<uint32_t>          sizes_;
+  std::vector<uint32_t>          defs_;
+  std::vector<stream::location>  locs_;
+};
+
+ast_kind ast_node::get_kind() const { return ast_->get_kind(index_); }
+
+symbol ast_symbol::get_sym() const { return ast_->get_sym(index_); }
+
+template<typename T, ast_kind K>
+uint32_t ast_vec<T, K>::first() const { return ast_->get_first(index_); }
+
+template<typename T, ast_kind K>
+typename ast_vec<T, K>::iterator ast_vec<T, K>::begin() const {
+  return iterator(ast_, first());
+}
+
+template<typename T, ast_kind K>
+typename ast_vec<T, K>::iterator ast_vec<T, K>::end() const {
+  return iterator(ast_, first() + ast_->get_size(index_));
+}
+
+template<typename T, ast_kind K>
+size_t ast_vec<T, K>::size() const { return ast_->get_size(index_); }
+
+ast_type_list ast_type_fn::get_inp() const {
+  return ast_type_list(ast_node(ast_, ast_->get_first(index_)));
+}
+
+ast_type_compound ast_type_fn::get_out() const {
+  return ast_type_compound(ast_node(ast_, ast_->get_first(index_) + 1));
+}
+
+// A definition's children are its name, type, arguments and body.
+ast_word ast_def::get_name() const {
+  return ast_word(ast_node(ast_, ast_->get_first(index_)));
+}
+
+ast_type_fn ast_def::get_type() const {
+  return ast_type_fn(ast_node(ast_, ast_->get_first(index_) + 1));
+}
+
+ast_arg_list ast_def::get_args() const {
+  return ast_arg_list(ast_node(ast_, ast_->get_first(index_) + 2));
+}
+
+ast_body ast_def::get_body() const {
+  return ast_body(ast_node(ast_, ast_->get_first(index_) + 3));
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "combinator.h"
+#include "construct.h"
+#include "debug.h"
+#include "parser.h"
+#include "scanner.h"
+#include "stats.h"
+#include "stream.h"
+
+#include <string_view>
+
+// The rules of the wildcat grammar, written with the combinators in
+// combinator.h. parse_def parses one whole definition; the rest are the
+// pieces it is built from.
+
+// Returns a view of the lexeme in the stream's buffer.
+inline std::string_view parse_many(parser& prs, scanner scn) {
+  DEBUG(std::cout << "parse_many: " << scn.get_id() << "\n");
+  parse_stats::count(prs.get_stats(), parse_stats::rule::MANY);
+  stream &s = prs.get_stream();
+  const char *begin = s.get_ptr();
+  prs.skip_run(scn);
+  std::string_view lexeme(begin, s.get_ptr() - begin);
+  if (lexeme.empty()) {
+    prs.add_error(parser::class_token(scn));
+    prs.set_valid(false);
+  }
+  return lexeme;
+}
+
+constexpr auto parse_spaces = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_spaces\n");
+  parse_stats::count(prs.get_stats(), parse_stats::rule::SPACES);
+  parse_many(prs, scanner::is_space);
+  return nullptr;
+};
+
+constexpr auto parse_maybe_spaces = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_maybe_spaces\n");
+  parse_stats::count(prs.get_stats(), parse_stats::rule::MAYBE_SPACES);
+  prs.skip_run(scanner::is_space);
+  return nullptr;
+};
+
+constexpr auto parse_eof = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_eof\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::END);
+  stream &s = prs.get_stream();
+  prs.set_valid(s.peek() == '\0');
+  return nullptr;
+};
+
+constexpr auto parse_arrow = parse_string<'-', '>'>;
+
+template<typename T>
+parser &parse_comma_sep(parser &prs, T run) {
+  DEBUG(std::cout << "parse_comma_sep\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::COMMA_SEP);
+  if (prs >> run)
+    while (do_try(prs, compose(parse_maybe_spaces, parse_char<','>)))
+      if (!do_try(prs, compose(parse_maybe_spaces, run)))
+        break;
+  return prs;
+}
+
+template<typename T>
+parser& parse_space_sep(parser &prs, T run) {
+  DEBUG(std::cout << "parse_space_sep\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::SPACE_SEP);
+  if (prs >> run)
+    while (do_try(prs, compose(parse_spaces, run)));
+  return prs;
+}
+
+constexpr auto parse_id = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_id\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::ID);
+  auto id = parse_many(prs, scanner::is_ident);
+  return !prs ? nullptr : prs.make<construct_id>(prs.intern(id));
+};
+
+constexpr auto parse_word = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_word\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::WORD);
+  auto word = parse_many(prs, scanner::is_word);
+  prs.set_valid(prs.is_valid() && word != ";");
+  return !prs ? nullptr : prs.make<construct_word>(prs.intern(word));
+};
+
+constexpr auto parse_type_id = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_type_id\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::TYPE_ID);
+  auto id = parse_many(prs, scanner::is_ident);
+  return !prs ? nullptr : prs.make<construct_type_id>(prs.intern(id));
+};
+
+constexpr auto parse_type_compound = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_type_compound\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::TYPE_COMPOUND);
+  if (parse_space_sep(prs, parse_type_id)) {
+    auto list = prs.gather_constructs<construct_type_id>();
+    return prs.make<construct_type_compound>(list);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_type_list = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_type_list\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::TYPE_LIST);
+  if (parse_comma_sep(prs, parse_type_compound)) {
+    auto list = prs.gather_constructs<construct_type_compound>();
+    return prs.make<construct_type_list>(list);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_type_fn = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_type_fn\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::TYPE_FN);
+  if (prs >> parse_char<'('>
+          >> parse_maybe_spaces >> parse_type_list
+          >> parse_maybe_spaces >> parse_arrow
+          >> parse_maybe_spaces >> maybe(parse_type_compound)
+          >> parse_maybe_spaces >> parse_char<')'>) {
+    construct_type_compound *out = prs.get_construct<construct_type_compound>();
+    if (!out) out = prs.make<construct_type_compound>();
+    construct_type_list *inp = prs.get_construct<construct_type_list>();
+    return prs.make<construct_type_fn>(inp, out);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_arg_id = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_arg_id\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::ARG_ID);
+  if (prs >> parse_id) {
+    construct_id *cid = prs.get_construct<construct_id>();
+    construct_arg_id *ctid = prs.make<construct_arg_id>(cid->get_sym());
+    return ctid;
+  }
+  return nullptr;
+};
+
+constexpr auto parse_arg_compound = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_arg_compound\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::ARG_COMPOUND);
+  if (parse_space_sep(prs, parse_arg_id)) {
+    auto list = prs.gather_constructs<construct_arg_id>();
+    return prs.make<construct_arg_compound>(list);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_arg_list = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_arg_list\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::ARG_LIST);
+  if (parse_comma_sep(prs, parse_arg_compound)) {
+    auto list = prs.gather_constructs<construct_arg_compound>();
+    return prs.make<construct_arg_list>(list);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_args = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_args\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::ARGS);
+  if (prs >> parse_char<'('> >> parse_maybe_spaces >> parse_arg_list
+          >> parse_maybe_spaces >> parse_char<')'>) {
+    return prs.get_construct<construct_arg_list>();
+  }
+  return nullptr;
+};
+
+constexpr auto parse_body = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_body\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::BODY);
+  if (parse_space_sep(prs, parse_word)) {
+    auto list = prs.gather_constructs<construct_word>();
+    return prs.make<construct_body>(list);
+  }
+  return nullptr;
+};
+
+constexpr auto parse_def = [](parser &prs) -> construct* {
+  DEBUG(std::cout << "parse_def\n");
+  parse_stats::scope scope(prs.get_stats(), parse_stats::rule::DEF);
+  stream::location loc = prs.get_stream().get_loc();
+  if (!(prs >> parse_word
+            >> parse_spaces       >> parse_char<':'>
+            >> parse_spaces       >> parse_type_fn
+            >> maybe(compose(parse_spaces, parse_args))
+            >> parse_maybe_spaces >> parse_arrow
+            >> maybe(compose(parse_maybe_spaces, parse_body))))
+    return nullptr;
+
+  // With this, unterminated definitions are not incorrectly shown as being
+  // on the line after the actual definition. This also avoids unterminated
+  // definitions generating two errors each.
+  parser::checkpoint cp = prs.mark();
+  if (!do_try(prs, compose(parse_spaces, parse_char<';'>))) {
+    prs.rollback(cp);
+    prs.clear_errors();
+    prs.set_valid(false);
+  }
+
+  if (prs) {
+    auto body = prs.get_construct<construct_body>();
+    if (!body) body = prs.make<construct_body>();
+    auto args = prs.get_construct<construct_arg_list>();
+    if (!args) args = prs.make<construct_arg_list>();
+    auto type = prs.get_construct<construct_type_fn>();
+    auto name = prs.get_construct<construct_word>();
+    return prs.make<construct_def>(name, type, args, body, loc);
+  }
+  return nullptr;
+};
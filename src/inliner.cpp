@@ -0,0 +1,105 @@
+#include "inliner.h"
+
+#include <algorithm>
+
+void inliner::inline_into(uint32_t def, const call_graph &graph) {
+  const std::vector<construct_def*> &defs = mod_.get_defs();
+  construct_body *body = defs[def]->get_body();
+  construct_list<construct_word> words = body->get_list();
+
+  std::vector<symbol> args;
+  for (construct_arg_compound *c : defs[def]->get_args()->get_list())
+    for (construct_arg_id *id : c->get_list())
+      args.push_back(id->get_sym());
+  auto is_arg = [&](construct_word *word) {
+    return std::find(args.begin(), args.end(), word->get_sym()) != args.end();
+  };
+
+  std::vector<construct_word*> result;
+  size_t size = words.size();
+  bool changed = false;
+  for (construct_word *word : words) {
+    uint32_t callee = is_arg(word) ? call_graph::none :
+                      graph.lookup(word->get_sym());
+    construct_list<construct_word> spliced;
+    if (callee != call_graph::none) {
+      spliced = defs[callee]->get_body()->get_list();
+      size_t n = spliced.size();
+      if (graph.is_recursive(callee) ||
+          !defs[callee]->get_args()->get_list().empty() ||
+          n > max_callee_ || (n > 1 && size + n - 1 > max_body_) ||
+          std::any_of(spliced.begin(), spliced.end(), is_arg))
+        callee = call_graph::none;
+    }
+
+    if (callee == call_graph::none) {
+      result.push_back(word);
+      continue;
+    }
+    result.insert(result.end(), spliced.begin(), spliced.end());
+    size += spliced.size() - 1;
+    ++inlined_[callee];
+    changed = true;
+  }
+
+  if (!changed)
+    return;
+  construct_word **list =
+    mod_.get_arena().make_array<construct_word*>(result.size());
+  std::copy(result.begin(), result.end(), list);
+  body->set_list(construct_list<construct_word>(list, list + result.size()));
+}
+
+void inliner::run() {
+  run(call_graph(mod_));
+}
+
+void inliner::run(thread_pool &pool) {
+  run(call_graph(mod_, pool));
+}
+
+void inliner::run(const call_graph &graph) {
+  const std::vector<construct_def*> &defs = mod_.get_defs();
+  inlined_.assign(defs.size(), 0);
+
+  before_ = 0;
+  for (const construct_def *def : defs)
+    before_ += def->get_body()->get_list().size();
+
+  for (uint32_t def : graph.get_order())
+    inline_into(def, graph);
+
+  after_ = 0;
+  for (const construct_def *def : defs)
+    after_ += def->get_body()->get_list().size();
+}
+
+void inliner::report(std::ostream &os) const {
+  const std::vector<construct_def*> &defs = mod_.get_defs();
+  size_t calls = 0, callees = 0;
+  for (uint32_t n : inlined_) {
+    calls += n;
+    callees += n != 0;
+  }
+
+  os << "inlined " << calls << (calls == 1 ? " call" : " calls") << " to "
+     << callees << (callees == 1 ? " word" : " words") << "; bodies went from "
+     << before_ << " to " << after_ << " words\n";
+
+  // The words inlined most often, then the rest in the order defined.
+  std::vector<uint32_t> top;
+  for (uint32_t i = 0; i != inlined_.size(); ++i)
+    if (inlined_[i])
+      top.push_back(i);
+  std::stable_sort(top.begin(), top.end(), [&](uint32_t a, uint32_t b) {
+    return inlined_[a] > inlined_[b];
+  });
+  const size_t shown = 10;
+  for (size_t i = 0; i != top.size() && i != shown; ++i) {
+    symbol name = defs[top[i]]->get_name()->get_sym();
+    os << "  " << mod_.get_symbols().get_name(name) << " x "
+       << inlined_[top[i]] << "\n";
+  }
+  if (top.size() > shown)
+    os << "  and " << top.size() - shown << " more\n";
+}
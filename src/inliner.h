@@ -0,0 +1,55 @@
+#pragma once
+
+#include "callgraph.h"
+#include "construct.h"
+#include "module.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Splices the bodies of small definitions into the bodies that call them, so
+// a word that only calls other words costs no calls of its own. Callers are
+// rewritten after their callees, so what gets spliced in has already had its
+// own calls inlined.
+//
+// Only definitions without arguments are inlined, since their bodies mean
+// the same anywhere, and never recursive ones. A body isn't inlined where the
+// caller has an argument with the same name as one of its words.
+class inliner {
+public:
+  explicit inliner(module &mod)
+    : mod_(mod), max_callee_(8), max_body_(64), before_(0), after_(0) { }
+
+  // The longest body, in words, that gets inlined.
+  void set_max_callee(size_t n) { max_callee_ = n; }
+  // The longest inlining can make a body, unless it makes it shorter.
+  void set_max_body(size_t n)   { max_body_ = n;   }
+
+  // Rewrites the bodies of the module's definitions.
+  void run();
+  // Same, but analyzes the calls between them on the given pool.
+  void run(thread_pool &pool);
+
+  // Writes how many calls were inlined, the words inlined most often, and
+  // how the number of words in all the bodies changed.
+  void report(std::ostream &os) const;
+
+private:
+  inliner(const inliner&) = delete;
+  inliner& operator=(const inliner&) = delete;
+
+  void run(const call_graph &graph);
+
+  // Inlines what can be into one definition's body.
+  void inline_into(uint32_t def, const call_graph &graph);
+
+  module &mod_;
+  size_t  max_callee_, max_body_;
+  // How many calls to each definition were inlined.
+  std::vector<uint32_t> inlined_;
+  // The number of words in all the bodies before and after.
+  size_t before_, after_;
+};
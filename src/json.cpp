@@ -0,0 +1,288 @@
+#include "json.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+const json &json::operator[](std::string_view key) const {
+  static const json null;
+  for (auto it = obj_.begin(), e = obj_.end(); it != e; ++it)
+    if (it->first == key)
+      return it->second;
+  return null;
+}
+
+json &json::set(std::string_view key, json value) {
+  for (auto it = obj_.begin(), e = obj_.end(); it != e; ++it)
+    if (it->first == key) {
+      it->second = std::move(value);
+      return *this;
+    }
+  obj_.emplace_back(std::string(key), std::move(value));
+  return *this;
+}
+
+json &json::push(json value) {
+  arr_.push_back(std::move(value));
+  return *this;
+}
+
+void json::write_string(std::string &out, std::string_view str) {
+  static const char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  for (char c : str) {
+    switch (c) {
+    case '"':  out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n";  break;
+    case '\r': out += "\\r";  break;
+    case '\t': out += "\\t";  break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        out += "\\u00";
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0xf]);
+      } else {
+        out.push_back(c);
+      }
+    }
+  }
+  out.push_back('"');
+}
+
+void json::write(std::string &out) const {
+  switch (ty_) {
+  case type::NUL:
+    out += "null";
+    break;
+  case type::BOOL:
+    out += bool_ ? "true" : "false";
+    break;
+  case type::NUMBER: {
+    char buf[32];
+    if (std::trunc(num_) == num_ && std::fabs(num_) < 1e15)
+      std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(num_));
+    else
+      std::snprintf(buf, sizeof(buf), "%.17g", num_);
+    out += buf;
+    break;
+  }
+  case type::STRING:
+    write_string(out, str_);
+    break;
+  case type::ARRAY:
+    out.push_back('[');
+    for (auto it = arr_.begin(), e = arr_.end(); it != e; ++it) {
+      if (it != arr_.begin())
+        out.push_back(',');
+      it->write(out);
+    }
+    out.push_back(']');
+    break;
+  case type::OBJECT:
+    out.push_back('{');
+    for (auto it = obj_.begin(), e = obj_.end(); it != e; ++it) {
+      if (it != obj_.begin())
+        out.push_back(',');
+      write_string(out, it->first);
+      out.push_back(':');
+      it->second.write(out);
+    }
+    out.push_back('}');
+    break;
+  }
+}
+
+std::string json::to_string() const {
+  std::string out;
+  write(out);
+  return out;
+}
+
+namespace {
+
+// A recursive descent parser over a complete JSON text.
+class reader {
+public:
+  reader(std::string_view text)
+    : cur_(text.data()), end_(text.data() + text.size()) {
+  }
+
+  bool parse(json &out) {
+    return parse_value(out, 0) && (skip_spaces(), cur_ == end_);
+  }
+
+private:
+  // Deeper nesting than this is rejected rather than risking the stack.
+  static const unsigned max_depth = 256;
+
+  char peek() const { return cur_ != end_ ? *cur_ : '\0'; }
+
+  void skip_spaces() {
+    while (cur_ != end_ &&
+           (*cur_ == ' ' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\t'))
+      ++cur_;
+  }
+
+  bool expect(char c) {
+    skip_spaces();
+    if (peek() != c)
+      return false;
+    ++cur_;
+    return true;
+  }
+
+  bool expect_word(std::string_view word) {
+    if (std::string_view(cur_, end_ - cur_).substr(0, word.size()) != word)
+      return false;
+    cur_ += word.size();
+    return true;
+  }
+
+  bool parse_value(json &out, unsigned depth) {
+    if (depth > max_depth)
+      return false;
+    skip_spaces();
+    switch (peek()) {
+    case 'n': out = json();      return expect_word("null");
+    case 't': out = json(true);  return expect_word("true");
+    case 'f': out = json(false); return expect_word("false");
+    case '"': {
+      std::string str;
+      if (!parse_string(str))
+        return false;
+      out = json(std::move(str));
+      return true;
+    }
+    case '[':
+      ++cur_;
+      out = json::array();
+      if (expect(']'))
+        return true;
+      do {
+        json elt;
+        if (!parse_value(elt, depth + 1))
+          return false;
+        out.push(std::move(elt));
+      } while (expect(','));
+      return expect(']');
+    case '{':
+      ++cur_;
+      out = json::object();
+      if (expect('}'))
+        return true;
+      do {
+        std::string key;
+        json value;
+        skip_spaces();
+        if (!parse_string(key) || !expect(':') ||
+            !parse_value(value, depth + 1))
+          return false;
+        out.set(key, std::move(value));
+      } while (expect(','));
+      return expect('}');
+    default:
+      return parse_number(out);
+    }
+  }
+
+  bool parse_number(json &out) {
+    const char *begin = cur_;
+    while (cur_ != end_ && (std::isdigit(static_cast<unsigned char>(*cur_)) ||
+                            *cur_ == '-' || *cur_ == '+' || *cur_ == '.' ||
+                            *cur_ == 'e' || *cur_ == 'E'))
+      ++cur_;
+    if (begin == cur_)
+      return false;
+    std::string str(begin, cur_);
+    char *end;
+    double n = std::strtod(str.c_str(), &end);
+    if (*end)
+      return false;
+    out = json(n);
+    return true;
+  }
+
+  bool parse_hex4(unsigned &code) {
+    if (end_ - cur_ < 4)
+      return false;
+    code = 0;
+    for (int i = 0; i != 4; ++i, ++cur_) {
+      char c = *cur_;
+      code <<= 4;
+      if (c >= '0' && c <= '9')      code |= c - '0';
+      else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+      else return false;
+    }
+    return true;
+  }
+
+  static void append_utf8(std::string &out, unsigned code) {
+    if (code < 0x80) {
+      out.push_back(code);
+    } else if (code < 0x800) {
+      out.push_back(0xc0 | (code >> 6));
+      out.push_back(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      out.push_back(0xe0 | (code >> 12));
+      out.push_back(0x80 | ((code >> 6) & 0x3f));
+      out.push_back(0x80 | (code & 0x3f));
+    } else {
+      out.push_back(0xf0 | (code >> 18));
+      out.push_back(0x80 | ((code >> 12) & 0x3f));
+      out.push_back(0x80 | ((code >> 6) & 0x3f));
+      out.push_back(0x80 | (code & 0x3f));
+    }
+  }
+
+  bool parse_string(std::string &out) {
+    if (peek() != '"')
+      return false;
+    ++cur_;
+    for (;;) {
+      // Copy the run of plain characters in one go.
+      const char *begin = cur_;
+      while (cur_ != end_ && *cur_ != '"' && *cur_ != '\\')
+        ++cur_;
+      out.append(begin, cur_);
+      if (cur_ == end_)
+        return false;
+      if (*cur_++ == '"')
+        return true;
+      if (cur_ == end_)
+        return false;
+      switch (char c = *cur_++) {
+      case '"': case '\\': case '/': out.push_back(c); break;
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'n': out.push_back('\n'); break;
+      case 'r': out.push_back('\r'); break;
+      case 't': out.push_back('\t'); break;
+      case 'u': {
+        unsigned code;
+        if (!parse_hex4(code))
+          return false;
+        // A surrogate pair encodes a code point past the first plane.
+        unsigned low;
+        if (code >= 0xd800 && code < 0xdc00 && expect_word("\\u") &&
+            parse_hex4(low) && low >= 0xdc00 && low < 0xe000)
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        append_utf8(out, code);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+  }
+
+  const char *cur_, *end_;
+};
+
+} // end anonymous namespace
+
+bool json::parse(std::string_view text, json &out) {
+  return reader(text).parse(out);
+}
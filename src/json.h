@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A JSON value. Objects keep their members in order and are looked up by a
+// linear search, which is all the small messages we exchange need.
+class json {
+public:
+  enum class type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  typedef std::vector<json>                        array_t;
+  typedef std::vector<std::pair<std::string, json>> object_t;
+
+  json()                    : ty_(type::NUL),    bool_(false), num_(0)    { }
+  json(bool b)              : ty_(type::BOOL),   bool_(b),     num_(0)    { }
+  json(int n)               : ty_(type::NUMBER), bool_(false), num_(n)    { }
+  json(unsigned n)          : ty_(type::NUMBER), bool_(false), num_(n)    { }
+  json(double n)            : ty_(type::NUMBER), bool_(false), num_(n)    { }
+  json(const char *s)       : ty_(type::STRING), bool_(false), num_(0),
+                              str_(s) { }
+  json(std::string s)       : ty_(type::STRING), bool_(false), num_(0),
+                              str_(std::move(s)) { }
+  json(std::string_view s)  : ty_(type::STRING), bool_(false), num_(0),
+                              str_(s) { }
+
+  static json array()  { json j; j.ty_ = type::ARRAY;  return j; }
+  static json object() { json j; j.ty_ = type::OBJECT; return j; }
+
+  type get_ty() const { return ty_; }
+
+  bool is_null()   const { return ty_ == type::NUL;    }
+  bool is_number() const { return ty_ == type::NUMBER; }
+  bool is_string() const { return ty_ == type::STRING; }
+  bool is_array()  const { return ty_ == type::ARRAY;  }
+  bool is_object() const { return ty_ == type::OBJECT; }
+
+  bool               get_bool()   const { return bool_; }
+  double             get_number() const { return num_;  }
+  const std::string &get_string() const { return str_;  }
+  const array_t     &get_array()  const { return arr_;  }
+  const object_t    &get_object() const { return obj_;  }
+
+  // Returns the member with the given name, or null if this isn't an object
+  // or has no such member.
+  const json &operator[](std::string_view key) const;
+
+  // Sets a member of an object, replacing any member of the same name.
+  json &set(std::string_view key, json value);
+  // Appends an element to an array.
+  json &push(json value);
+
+  // Appends the value's serialization to out.
+  void write(std::string &out) const;
+  std::string to_string() const;
+
+  // Appends str to out as a JSON string, quoted and escaped.
+  static void write_string(std::string &out, std::string_view str);
+
+  // Parses text as a single JSON value. Returns false if it isn't one.
+  static bool parse(std::string_view text, json &out);
+
+private:
+  type        ty_;
+  bool        bool_;
+  double      num_;
+  std::string str_;
+  array_t     arr_;
+  object_t    obj_;
+};
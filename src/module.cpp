@@ -0,0 +1,55 @@
+#include "module.h"
+
+namespace {
+
+// Rewrites every symbol under a definition through a mapping from the symbol
+// table it was parsed with to another one.
+class remapper {
+public:
+  remapper(const std::vector<symbol> &map) : map_(map) { }
+
+  void remap(construct_symbol *c) {
+    c->set_sym(map_[c->get_sym().get_id()]);
+  }
+
+  template<typename T>
+  void remap(construct_vec<T> *c) {
+    for (T *t : c->get_list())
+      remap(t);
+  }
+
+  void remap(construct_type_fn *c) {
+    remap(c->get_inp());
+    remap(c->get_out());
+  }
+
+  void remap(construct_def *c) {
+    remap(c->get_name());
+    remap(c->get_type());
+    remap(c->get_args());
+    remap(c->get_body());
+  }
+
+private:
+  const std::vector<symbol> &map_;
+};
+
+} // end anonymous namespace
+
+void module::merge(module &&other) {
+  const symbol_table &syms = other.get_symbols();
+  std::vector<symbol> map;
+  map.reserve(syms.size());
+  for (uint32_t i = 0, e = syms.size(); i != e; ++i)
+    map.push_back(syms_.intern(syms.get_name(symbol(i))));
+
+  remapper r(map);
+  for (construct_def *def : other.defs_) {
+    r.remap(def);
+    defs_.push_back(def);
+  }
+
+  arena_.adopt(std::move(other.arena_));
+  valid_ = valid_ && other.valid_;
+  other.defs_.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "arena.h"
+#include "construct.h"
+#include "symbol.h"
+
+#include <utility>
+#include <vector>
+
+// The result of parsing one source file. The module's arena owns every
+// construct created while parsing it, and they all go away with the module.
+class module {
+public:
+  module() : valid_(true) { }
+  module(module &&other) = default;
+
+  module& operator=(module &&other) = default;
+
+  arena &get_arena() { return arena_; }
+
+  symbol_table       &get_symbols()       { return syms_; }
+  const symbol_table &get_symbols() const { return syms_; }
+
+  const std::vector<construct_def*> &get_defs() const { return defs_; }
+  void add_def(construct_def *def) { defs_.push_back(def); }
+  // Replaces the list of definitions. Constructs dropped from it stay in the
+  // arena until the module goes away.
+  void set_defs(std::vector<construct_def*> defs) { defs_ = std::move(defs); }
+
+  // Appends the other module's definitions to this one, taking over their
+  // constructs and re-interning their names in this module's symbol table.
+  void merge(module &&other);
+
+  // Whether the whole file parsed without errors.
+  bool is_valid()            const { return valid_;  }
+  void set_valid(bool valid)       { valid_ = valid; }
+
+private:
+  module(const module&) = delete;
+  module& operator=(const module&) = delete;
+
+  arena                       arena_;
+  symbol_table                syms_;
+  std::vector<construct_def*> defs_;
+  bool                        valid_;
+};
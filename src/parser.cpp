@@ -1,393 +1,427 @@
 #include "parser.h"
 #include "color.h"
 #include "construct.h"
+#include "debug.h"
+#include "grammar.h"
 #include "scanner.h"
 #include "stream.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <iostream>
-
-#ifdef __DEBUG__
-#define DEBUG(X) X
-#else
-#define DEBUG(X)
-#endif
-
-static std::string make_expected(char expected) {
-  std::string s(1, '\''); s.push_back(expected); s.push_back('\'');
-  return s;
-}
-
-static std::string make_expected(std::string expected) {
-  std::string s(1, '\"'); s.append(expected); s.push_back('\"');
-  return s;
-}
-
-parser::error::error(char expected, char got, stream::location loc)
-  : expected_(make_expected(expected)), got_(got), loc_(loc) {
-}
-parser::error::error(scanner expected, char got, stream::location loc)
-  : expected_(expected.get_id()), got_(got), loc_(loc) {
-}
-parser::error::error(std::string expected, char got, stream::location loc)
-  : expected_(make_expected(expected)), got_(got), loc_(loc) {
-}
-
-typedef std::pair<parser, construct*> parser_pair_ty;
-
-template <typename T>
-parser& operator>>(parser &prs, T run) {
-  // Stop parsing if the stream is invalid.
-  if (!prs)
-    return prs;
-
-  stream& s = prs.get_stream();
-  stream::location before = s.get_loc();
-
-  parser_pair_ty pair = run(prs);
-  if ((prs = pair.first) && before != s.get_loc())
-    // Clear all the errors located before whatever we just parsed.
-    prs.clear_errors(s.get_loc());
-  if (pair.second)
-    prs.add_construct(pair.second);
-  return prs;
-}
-
-parser& operator<<(parser &prs, parser new_prs) {
-  return prs = new_prs;
-}
-
-static std::function<parser_pair_ty(parser)> parse_char(char c) {
-  return [c](parser prs) {
-    DEBUG(std::cout << "parse_char: " << c << "\n");
-    stream &s = prs.get_stream();
-    char peek = s.peek();
-    if (peek == c) {
-      s.next();
-    } else {
-      prs.add_error(parser::error(c, peek, s.get_loc()));
-      prs.set_valid(false);
-    }
-    return parser_pair_ty(prs, nullptr);
-  };
-}
-
-static std::function<parser_pair_ty(parser)> parse_string(const char *str) {
-  return [str](parser prs) {
-    DEBUG(std::cout << "parse_string: " << str << "\n");
-    stream &s = prs.get_stream();
-    const char *ostr = str;
-    while (*ostr && s.peek() == *ostr) { ++ostr; s.next(); }
-    if (*ostr) {
-      prs.add_error(parser::error(str, s.peek(), s.get_loc()));
-      prs.set_valid(false);
-    }
-    return parser_pair_ty(prs, nullptr);
-  };
-}
-
-static std::string parse_many(parser& prs, scanner scn) {
-  DEBUG(std::cout << "parse_many: " << scn.get_id() << "\n");
-  stream &s = prs.get_stream();
-  std::string lexeme;
-  while (scn(s.peek()))
-    lexeme.push_back(s.next());
-  if (lexeme.empty()) {
-    prs.add_error(parser::error(scn, s.peek(), s.get_loc()));
-    prs.set_valid(false);
+#include <mutex>
+
+// The strings string_token() has handed out tokens for, in order.
+static std::mutex strings_mutex;
+static std::vector<std::string> strings;
+
+parser::token parser::string_token(const char *str) {
+  std::lock_guard<std::mutex> lock(strings_mutex);
+  auto it = std::find(strings.begin(), strings.end(), str);
+  if (it == strings.end())
+    it = strings.insert(it, str);
+  return 512 + (it - strings.begin());
+}
+
+std::string parser::describe(token t) {
+  if (t < 256)
+    return std::string(1, '\'') + static_cast<char>(t) + '\'';
+  if (t >= 512) {
+    std::lock_guard<std::mutex> lock(strings_mutex);
+    return '"' + strings[t - 512] + '"';
   }
-  return lexeme;
-}
-
-
-template<typename T>
-static std::function<parser_pair_ty(parser)> maybe(T run) {
-  return [run](parser prs) {
-    auto copy_prs = prs;
-    if (prs >> run)
-      return parser_pair_ty(prs, nullptr);
-     return parser_pair_ty(copy_prs, nullptr);
-  };
-}
-
-template<typename T, typename U>
-static std::function<parser_pair_ty(parser)> compose(T first, U second) {
-  return [first, second](parser prs) {
-    prs >> first >> second;
-    return parser_pair_ty(prs, nullptr);
-  };
+  for (const scanner *scn : { &scanner::is_space, &scanner::is_ident,
+                              &scanner::is_word })
+    if (class_token(*scn) == t)
+      return scn->get_id();
+  return std::string();
+}
+
+void parser::failure::add(token t, char got, stream::location loc) {
+  if (count_ && loc.get_offset() < loc_.get_offset())
+    return;
+  if (!count_ || loc.get_offset() > loc_.get_offset()) {
+    loc_ = loc;
+    got_ = got;
+    count_ = 0;
+  }
+  if (std::find(tokens_, tokens_ + count_, t) == tokens_ + count_ &&
+      count_ != capacity)
+    tokens_[count_++] = t;
 }
 
-template<typename T>
-static bool do_try(parser &prs, T run) {
-  auto copy_prs = prs;
-  if (prs >> run)
-    return true;
-  copy_prs.merge_errors(prs);
-  prs = copy_prs;
-  return false;
+void parser::failure::merge(const failure &f) {
+  if (!f.count_)
+    return;
+  if (!count_ || f.loc_.get_offset() > loc_.get_offset()) {
+    *this = f;
+    return;
+  }
+  if (f.loc_.get_offset() < loc_.get_offset())
+    return;
+  for (uint8_t i = 0; i != f.count_; ++i)
+    if (std::find(tokens_, tokens_ + count_, f.tokens_[i]) ==
+        tokens_ + count_ && count_ != capacity)
+      tokens_[count_++] = f.tokens_[i];
+}
+
+std::string parser::failure::get_message() const {
+  std::vector<std::string> names;
+  for (uint8_t i = 0; i != count_; ++i)
+    names.push_back(describe(tokens_[i]));
+  std::sort(names.begin(), names.end());
+
+  std::string msg = "expected ";
+  if (names.size() == 1) {
+    msg += names[0];
+  } else if (names.size() == 2) {
+    msg += names[0] + " or " + names[1];
+  } else {
+    for (size_t i = 0; i + 1 != names.size(); ++i)
+      msg += names[i] + ", ";
+    msg += "or " + names.back();
+  }
+  msg += ", got '";
+  msg += got_;
+  msg += "'";
+  return msg;
 }
 
-static parser_pair_ty parse_spaces(parser prs) {
-  DEBUG(std::cout << "parse_spaces\n");
-  auto spaces = parse_many(prs, scanner::is_space);
-  return parser_pair_ty(prs, nullptr);
+void parser::rollback(const checkpoint &cp) {
+  if (stats_)
+    ++stats_->rollbacks;
+  restore(cp);
+  fail_ = cp.fail_;
 }
 
-static parser_pair_ty parse_maybe_spaces(parser prs) {
-  DEBUG(std::cout << "parse_maybe_spaces\n");
-  stream &s = prs.get_stream();
-  while (scanner::is_space(s.peek())) s.next();
-  return parser_pair_ty(prs, nullptr);
+void parser::backtrack(const checkpoint &cp) {
+  if (stats_)
+    ++stats_->backtracks;
+  // Errors cleared since the checkpoint was taken count again.
+  fail_.merge(cp.fail_);
+  restore(cp);
 }
 
-static parser_pair_ty parse_eof(parser prs) {
-  DEBUG(std::cout << "parse_eof\n");
-  stream &s = prs.get_stream();
-  prs.set_valid(s.peek() == '\0');
-  return parser_pair_ty(prs, nullptr);
+void parser::restore(const checkpoint &cp) {
+  assert(cons_.size() >= cp.cons_ && "Constructs popped past checkpoint");
+  cons_.resize(cp.cons_);
+  stream_.set_loc(cp.loc_);
+  valid_ = cp.valid_;
 }
 
-static parser &parse_comma_sep(parser &prs,
-                               parser_pair_ty (*run)(parser)) {
-  DEBUG(std::cout << "parse_comma_sep\n");
-  if (prs >> run)
-    while (do_try(prs, compose(parse_maybe_spaces, parse_char(','))))
-      if (!do_try(prs, compose(parse_maybe_spaces, run)))
-        break;
-  return prs;
+void parser::reset() {
+  clear_errors();
+  cons_.clear();
+  valid_ = true;
 }
 
-static parser& parse_space_sep(parser &prs,
-                               parser_pair_ty (*run)(parser)) {
-  DEBUG(std::cout << "parse_space_sep\n");
-  if (prs >> run)
-    while (do_try(prs, compose(parse_spaces, run)));
-  return prs;
+void parser::print_error_loc(std::ostream &os, stream::location loc) const {
+  // A window onto a longer source may only hold the end of its first line.
+  stream::location begin = stream_.get_line_begin(loc);
+  os << stream_.get_line(loc) << "\n"
+     << std::string(loc.get_offset() - begin.get_offset(), ' ')
+     << "^" << "\n";
 }
 
-static parser_pair_ty parse_id(parser prs) {
-  DEBUG(std::cout << "parse_id\n");
-  auto id = parse_many(prs, scanner::is_ident);
-  return parser_pair_ty(prs, !prs ? nullptr : new construct_id(id));
+void parser::report(stream::location loc, const std::string &message) {
+  if (diags_) {
+    diags_->push_back(diagnostic(loc, message));
+    return;
+  }
+  stream::position pos = stream_.get_position(loc);
+  *diag_ << stream_.get_filename() << ":" << pos.get_line() << ":"
+         << pos.get_col() << ": " << color::code::red << "error:"
+         << color::code::reset << " " << message << "\n";
+  print_error_loc(*diag_, loc);
 }
 
-static parser_pair_ty parse_word(parser prs) {
-  DEBUG(std::cout << "parse_word\n");
-  auto word = parse_many(prs, scanner::is_word);
-  prs.set_valid(prs.is_valid() && word != ";");
-  return parser_pair_ty(prs, !prs ? nullptr : new construct_word(word));
+void parser::report_errors() {
+  report(fail_.get_loc(), fail_.get_message());
 }
 
-static parser_pair_ty parse_type_id(parser prs) {
-  DEBUG(std::cout << "parse_type_id\n");
-  auto id = parse_many(prs, scanner::is_ident);
-  return parser_pair_ty(prs, !prs ? nullptr : new construct_type_id(id));
+void parser::report_unterminated(stream::location loc) {
+  report(loc, "unterminated definition");
 }
 
-static parser_pair_ty parse_type_compound(parser prs) {
-  DEBUG(std::cout << "parse_type_compound\n");
-  if (parse_space_sep(prs, parse_type_id)) {
-    auto list = prs.gather_constructs<construct_type_id>();
-    return parser_pair_ty(prs, new construct_type_compound(list));
-  }
-  return parser_pair_ty(prs, nullptr);
+void parser::add_construct(construct *c) {
+  cons_.push_back(c);
 }
 
-static parser_pair_ty parse_type_list(parser prs) {
-  DEBUG(std::cout << "parse_type_list\n");
-  if (parse_comma_sep(prs, parse_type_compound)) {
-    auto list = prs.gather_constructs<construct_type_compound>();
-    return parser_pair_ty(prs, new construct_type_list(list));
-  }
-  return parser_pair_ty(prs, nullptr);
-}
+const parser::sync_point &parser::find_sync(size_t offset) {
+  const char *base = stream_.get_ptr() - (stream_.get_loc().get_offset() -
+                                          stream_.get_origin().get_offset());
+  const char *end = stream_.get_end();
+  auto covers = [&] {
+    return !syncs_.empty() && syncs_.back().limit > offset;
+  };
 
-static parser_pair_ty parse_type_fn(parser prs) {
-  if (prs >> parse_char('(')
-          >> parse_maybe_spaces >> parse_type_list
-          >> parse_maybe_spaces >> parse_string("->")
-          >> parse_maybe_spaces >> maybe(parse_type_compound)
-          >> parse_maybe_spaces >> parse_char(')')) {
-    construct_type_compound *out = prs.get_construct<construct_type_compound>();
-    if (!out) out = new construct_type_compound();
-    construct_type_list *inp = prs.get_construct<construct_type_list>();
-    return parser_pair_ty(prs, new construct_type_fn(inp, out));
+  // Start over if the cursor is outside what's been indexed, which can
+  // happen when the parse is restarted somewhere else.
+  if (offset < sync_begin_ || (!covers() && offset > sync_end_)) {
+    syncs_.clear();
+    sync_begin_ = sync_end_ = offset;
   }
-  return parser_pair_ty(prs, nullptr);
-}
 
-static parser_pair_ty parse_arg_id(parser prs) {
-  DEBUG(std::cout << "parse_arg_id\n");
-  if (prs >> parse_id) {
-    construct_id *cid = prs.get_construct<construct_id>();
-    construct_arg_id *ctid = new construct_arg_id(cid->get_str());
-    return parser_pair_ty(prs, ctid);
+  while (!covers()) {
+    const char *s = scanner::is_word.scan(base + sync_end_, end);
+    const char *e = scanner::is_space.scan(s, end);
+    sync_point sp;
+    sp.begin = s - base;
+    sp.limit = e - base;
+    sync_end_ = e - base;
+
+    // The probes below only depend on what follows the run of spaces.
+    if (e == end || *e == '\0') {
+      sp.k = sync_point::kind::END;
+      sp.limit = e - base + 1;
+      sp.resume = e - base;
+      syncs_.push_back(sp);
+      continue;
+    }
+    if (*e == ';' && e + 1 != end && scanner::is_space(e[1])) {
+      sp.k = sync_point::kind::TERMINATOR;
+      sp.resume = scanner::is_space.scan(e + 1, end) - base;
+      syncs_.push_back(sp);
+      continue;
+    }
+    const char *w = scanner::is_word.scan(e, end);
+    const char *colon = scanner::is_space.scan(w, end);
+    if ((w - e != 1 || *e != ';') && colon != w && colon != end &&
+        *colon == ':' && colon + 1 != end && scanner::is_space(colon[1])) {
+      sp.k = sync_point::kind::HEAD;
+      sp.resume = sp.begin;
+      syncs_.push_back(sp);
+    }
   }
-  return parser_pair_ty(prs, nullptr);
-}
 
-static parser_pair_ty parse_arg_compound(parser prs) {
-  DEBUG(std::cout << "parse_arg_compound\n");
-  if (parse_space_sep(prs, parse_arg_id)) {
-    auto list = prs.gather_constructs<construct_arg_id>();
-    return parser_pair_ty(prs, new construct_arg_compound(list));
-  }
-  return parser_pair_ty(prs, nullptr);
+  return *std::upper_bound(syncs_.begin(), syncs_.end(), offset,
+                           [](size_t offset, const sync_point &sp) {
+                             return offset < sp.limit;
+                           });
 }
 
-static parser_pair_ty parse_arg_list(parser prs) {
-  DEBUG(std::cout << "parse_arg_list\n");
-  if (parse_comma_sep(prs, parse_arg_compound)) {
-    auto list = prs.gather_constructs<construct_arg_compound>();
-    return parser_pair_ty(prs, new construct_arg_list(list));
+void parser::advance() {
+  // This is where parsing "spaces ';' spaces" or "spaces word spaces ':'
+  // spaces" would first succeed if tried at every offset from the cursor
+  // on, but found without trying them.
+  reset();
+  size_t offset = stream_.get_loc().get_offset() -
+                  stream_.get_origin().get_offset();
+  const char *base = stream_.get_ptr() - offset;
+  const sync_point &sp = find_sync(offset);
+  if (stats_) {
+    ++stats_->advances;
+    stats_->skipped += (sp.k == sync_point::kind::HEAD ?
+                        std::max(offset, sp.begin) : sp.resume) - offset;
   }
-  return parser_pair_ty(prs, nullptr);
-}
-
-static parser_pair_ty parse_args(parser prs) {
-  DEBUG(std::cout << "parse_args\n");
-  if (prs >> parse_char('(') >> parse_maybe_spaces >> parse_arg_list
-          >> parse_maybe_spaces >> parse_char(')')) {
-    return parser_pair_ty(prs, prs.get_construct<construct_arg_list>());
+  stream_.skip_to(base + std::max(offset, sp.begin));
+
+  switch (sp.k) {
+  case sync_point::kind::TERMINATOR:
+    stream_.skip_to(base + sp.resume);
+    return;
+  case sync_point::kind::HEAD:
+    report_unterminated(stream_.get_loc());
+    return;
+  case sync_point::kind::END:
+    hit_eof_ = true;
+    report_unterminated(stream_.get_loc());
+    stream_.skip_to(base + sp.resume);
+    return;
   }
-  return parser_pair_ty(prs, nullptr);
 }
 
-static parser_pair_ty parse_body(parser prs) {
-  DEBUG(std::cout << "parse_body\n");
-  if (parse_space_sep(prs, parse_word)) {
-    auto list = prs.gather_constructs<construct_word>();
-    return parser_pair_ty(prs, new construct_body(list));
+void parser::recall_run(const scanner &scn) {
+  if (runs_used_ * 2 >= runs_.size())
+    grow_runs();
+
+  uint64_t key = stream_.get_loc().get_offset() * 4 +
+                 static_cast<uint64_t>(scn.get_kind());
+  size_t mask = runs_.size() - 1;
+  for (size_t i = (key * 0x9e3779b97f4a7c15ull) >> 32 & mask;;
+       i = (i + 1) & mask) {
+    run_entry &e = runs_[i];
+    if (e.gen == runs_gen_ && e.key == key) {
+      if (stats_)
+        ++stats_->runs_recalled;
+      stream_.set_loc(e.end);
+      return;
+    }
+    if (e.gen != runs_gen_) {
+      stream_.skip_to(scn.scan(stream_.get_ptr(), stream_.get_end()));
+      e.key = key;
+      e.gen = runs_gen_;
+      e.end = stream_.get_loc();
+      ++runs_used_;
+      return;
+    }
   }
-  return parser_pair_ty(prs, nullptr);
 }
 
-static parser_pair_ty parse_def(parser prs) {
-  DEBUG(std::cout << "parse_def\n");
-  if (!(prs >> parse_word
-            >> parse_spaces       >> parse_char(':')
-            >> parse_spaces       >> parse_type_fn
-            >> maybe(compose(parse_spaces, parse_args))
-            >> parse_maybe_spaces >> parse_string("->")
-            >> maybe(compose(parse_maybe_spaces, parse_body))))
-    return parser_pair_ty(prs, nullptr);
-
-  // With this, unterminated definitions are not incorrectly shown as being
-  // on the line after the actual definition. This also avoids unterminated
-  // definitions generating two errors each.
-  auto errors = prs.get_errors();
-  if (!do_try(prs, compose(parse_spaces, parse_char(';')))) {
-    prs.set_errors(errors);
-    prs.set_valid(false);
-  }
-
-  if (prs) {
-    auto body = prs.get_construct<construct_body>();
-    if (!body) body = new construct_body();
-    auto args = prs.get_construct<construct_arg_list>();
-    if (!args) args = new construct_arg_list();
-    auto type = prs.get_construct<construct_type_fn>();
-    auto name = prs.get_construct<construct_word>();
-    return parser_pair_ty(prs, new construct_def(name, type, args, body));
+void parser::forget_runs() {
+  runs_used_ = 0;
+  if (++runs_gen_ == 0) {
+    // Entries from 2^32 generations ago would look live again.
+    runs_.clear();
+    runs_gen_ = 1;
   }
-  return parser_pair_ty(prs, nullptr);
-}
-
-void parser::add_error(error err) {
-  errors_.insert(err);
-}
-
-void parser::merge_errors(parser &prs) {
-  auto errors = prs.errors_;
-  errors_.insert(errors.begin(), errors.end());
-}
-
-void parser::clear_errors() {
-  errors_.clear();
-}
-
-void parser::clear_errors(stream::location loc) {
-  auto it = errors_.begin(), e = errors_.end();
-  while (it != e)
-    if (it->get_loc() < loc)
-      it = errors_.erase(it);
-    else
-      ++it;
-}
-
-void parser::print_error_loc(std::ostream &os, stream::location loc) const {
-  os << stream_.get_line(loc.get_line()) << "\n"
-     << std::string(loc.get_col() > 1 ? loc.get_col() - 1 : 0, ' ')
-     << "^" << "\n";
 }
 
-void parser::print_errors(std::ostream &os) const {
-  auto it = errors_.begin(), e = errors_.end();
-  stream::location loc = it->get_loc();
-  os << stream_.get_filename() << ":" << loc.get_line() << ":"
-     << loc.get_col() << ": " << color::code::red << "error:"
-     << color::code::reset << " expected ";
-  if (errors_.size() == 1) {
-    os << it->get_expected();
-  } else if (errors_.size() == 2) {
-    os << it->get_expected() << " or " << (++it)->get_expected();
-  } else {
-    for (; it != std::prev(e); ++it)
-      os << it->get_expected() << ", ";
-    os << "or " << it->get_expected();
+void parser::grow_runs() {
+  std::vector<run_entry> old(std::max<size_t>(runs_.size() * 2, 64));
+  old.swap(runs_);
+  size_t mask = runs_.size() - 1;
+  for (const run_entry &e : old) {
+    if (e.gen != runs_gen_)
+      continue;
+    size_t i = (e.key * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+    while (runs_[i].gen == runs_gen_)
+      i = (i + 1) & mask;
+    runs_[i] = e;
   }
-  os << ", got '" << it->get_got() << "'" << "\n";
-  print_error_loc(os, loc);
-}
-
-void parser::print_error_unterminated(std::ostream &os,
-                                      stream::location loc) const {
-  os << stream_.get_filename() << ":" << loc.get_line() << ":"
-     << loc.get_col() << ": " << color::code::red << "error:"
-     << color::code::reset << " unterminated definition" << "\n";
-  print_error_loc(os, loc);
-}
-
-void parser::add_construct(construct *c) {
-  cons_.push(c);
 }
 
-void parser::advance() {
-  stream::location loc = stream_.get_loc();
-  for (; !(*this << parser(stream_) >> parse_maybe_spaces >> parse_eof);
-       stream_.set_loc(loc), stream_.next(), loc = stream_.get_loc()) {
-
-    stream_.set_loc(loc);
-    if (*this << parser(stream_) >> parse_spaces >> parse_char(';')
-              >> parse_spaces)
-      return;
-
-    stream_.set_loc(loc);
-    if (*this << parser(stream_) >> parse_spaces >> parse_word
-              >> parse_spaces >> parse_char(':') >> parse_spaces) {
-      stream_.set_loc(loc);
-      print_error_unterminated(std::cerr, loc);
-      return;
-    }
-  }
-  print_error_unterminated(std::cerr, loc);
+module parser::parse() {
+  module mod;
+  parse_defs(mod, nullptr);
+  return mod;
 }
 
-bool parser::parse() {
-  bool has_error = false;
+void parser::parse_defs(module &mod,
+                        const std::function<bool(size_t)> &stop) {
+  mod_ = &mod;
   while (*this >> parse_maybe_spaces && stream_.peek() != '\0') {
+    if (stop && fail_.empty() && stop(stream_.get_loc().get_offset()))
+      break;
+    if (packrat_)
+      forget_runs();
     if (*this >> parse_def) {
-      DEBUG(std::cout << "parse_def: " << *get_construct<construct_def>()
-                      << "\n");
+      construct_def *def = get_construct<construct_def>();
+      DEBUG(std::cout << "parse_def: ";
+            def->print(std::cout, mod.get_symbols());
+            std::cout << "\n");
+      mod.add_def(def);
       continue;
     }
-    has_error = true;
-    if (!errors_.empty()) {
-      print_errors(std::cerr);
+    mod.set_valid(false);
+    if (!fail_.empty()) {
+      report_errors();
       clear_errors();
     }
     advance();
   }
-  return !has_error;
+  mod_ = nullptr;
 }
 
+bool parser::parse_piece(module &mod) {
+  parse_defs(mod, nullptr);
+  return !hit_eof_ && fail_.empty();
+}
+
+const char *parser::find_def_end(const char *p, const char *end) {
+  if (p == end)
+    return end;
+  for (++p; p != end; ++p) {
+    p = static_cast<const char*>(std::memchr(p, ';', end - p));
+    if (!p)
+      return end;
+    if (scanner::is_space(p[-1]) && p + 1 != end &&
+        scanner::is_space(p[1]))
+      return scanner::is_space.scan(p + 1, end);
+  }
+  return end;
+}
+
+namespace {
+
+// A piece of the source parsed on its own by parse(thread_pool&).
+struct chunk {
+  stream::location                begin;
+  size_t                          end;
+  module                          mod;
+  // Kept until the chunks are merged, and reported then if the chunk's parse
+  // is kept. Slices share their source's locations, so they're reported as
+  // they are.
+  std::vector<parser::diagnostic> diags;
+  parse_stats                     stats;
+  // Whether the chunk's parse can be trusted to be what a serial parse would
+  // have produced for the same text.
+  bool                            clean;
+};
+
+// Splits the stream into chunks of roughly the given size, each but the last
+// ending where a definition most likely ends.
+std::vector<chunk> split(stream s, size_t size) {
+  std::vector<chunk> chunks;
+  const char *end = s.get_end();
+  while (s.get_ptr() != end) {
+    chunk c;
+    c.begin = s.get_loc();
+    const char *p = s.get_ptr() + std::min<size_t>(size, end - s.get_ptr());
+    s.skip_to(parser::find_def_end(p - 1, end));
+    c.end = s.get_loc().get_offset();
+    c.clean = false;
+    chunks.push_back(std::move(c));
+  }
+  return chunks;
+}
+
+} // end anonymous namespace
+
+module parser::parse(thread_pool &pool) {
+  // Not worth splitting up small files.
+  const size_t min_chunk = 64 * 1024;
+  size_t size = std::max(stream_.get_size() / (pool.size() * 4), min_chunk);
+  std::vector<chunk> chunks = split(stream_, size);
+  if (chunks.size() < 2)
+    return parse();
+
+  pool.parallel_for(chunks.size(), [&](size_t i) {
+    chunk &c = chunks[i];
+    parser prs(stream_.slice(c.begin, c.end));
+    prs.set_diagnostics(c.diags);
+    prs.set_stats(stats_ ? &c.stats : nullptr);
+    prs.set_packrat(packrat_);
+    // The last chunk runs to the real end of the source, so it always parses
+    // the way a serial parse would.
+    c.clean = prs.parse_piece(c.mod) || i + 1 == chunks.size();
+  });
+
+  if (stats_)
+    for (const chunk &c : chunks)
+      stats_->merge(c.stats);
+
+  module mod;
+  for (size_t i = 0, e = chunks.size(); i != e;) {
+    if (chunks[i].clean) {
+      for (const diagnostic &d : chunks[i].diags)
+        report(d.loc, d.message);
+      mod.merge(std::move(chunks[i].mod));
+      ++i;
+      continue;
+    }
+
+    // Error recovery in this chunk may have needed text past its end. Parse
+    // serially from its start until we line up with a later chunk that
+    // parsed cleanly.
+    size_t next = e, j = i + 1;
+    auto stop = [&](size_t offset) {
+      while (j != e && chunks[j].begin.get_offset() < offset)
+        ++j;
+      if (j != e && chunks[j].begin.get_offset() == offset && chunks[j].clean) {
+        next = j;
+        return true;
+      }
+      return false;
+    };
+
+    module part;
+    stream_.set_loc(chunks[i].begin);
+    reset();
+    parse_defs(part, stop);
+    mod.merge(std::move(part));
+    i = next;
+  }
+  return mod;
+}
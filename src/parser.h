@@ -1,95 +1,315 @@
 #pragma once
 
 #include "construct.h"
+#include "module.h"
 #include "rtti.h"
 #include "scanner.h"
+#include "stats.h"
 #include "stream.h"
+#include "thread_pool.h"
 
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <ostream>
-#include <set>
-#include <stack>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class parser {
 public:
-  parser(stream s) : stream_(s), valid_(true) { }
+  parser(stream s)
+    : stream_(s), valid_(true), diag_(&std::cerr), diags_(nullptr),
+      hit_eof_(false), mod_(nullptr), stats_(nullptr), packrat_(false),
+      runs_used_(0), runs_gen_(1), sync_begin_(0), sync_end_(0) {
+  }
+
+  // Something a rule expected to find: a character, a character class or a
+  // string. Tokens are small integers, so recording what was expected costs
+  // nothing; they're only turned into text when an error is reported.
+  typedef uint16_t token;
+
+  static token char_token(char c) { return static_cast<unsigned char>(c); }
+  static token class_token(const scanner &scn) {
+    return 256 + static_cast<token>(scn.get_kind());
+  }
+  // Returns the same token every time it's given the same string.
+  static token string_token(const char *str);
 
-  class error {
+  // How a token is shown in a diagnostic.
+  static std::string describe(token t);
+
+  // The furthest place parsing failed so far, and the tokens that were
+  // expected there. Failures anywhere before it can't be what a diagnostic
+  // is about, so they're forgotten.
+  class failure {
   public:
-    error(char expected, char got, stream::location loc);
-    error(scanner expected, char got, stream::location loc);
-    error(std::string expected, char got, stream::location loc);
+    // No place in the grammar expects more tokens than this; more are
+    // dropped.
+    static const size_t capacity = 8;
 
-    std::string      get_expected() const { return expected_; }
-    char             get_got()      const { return got_;      }
-    stream::location get_loc()      const { return loc_;      }
+    failure() : got_('\0'), count_(0) { }
 
-    bool operator<(const error &e) const {
-      return expected_ < e.expected_ || got_ < e.got_ || loc_ < e.loc_;
-    }
+    bool             empty()   const { return count_ == 0; }
+    stream::location get_loc() const { return loc_;        }
+    char             get_got() const { return got_;        }
+
+    void clear() { count_ = 0; }
+
+    // Records that t was expected at loc, where got was found instead.
+    void add(token t, char got, stream::location loc);
+    // Keeps whichever of this and f is further along, or both if they're at
+    // the same place.
+    void merge(const failure &f);
+
+    // Returns "expected X, Y, or Z, got 'c'", with the tokens in order.
+    std::string get_message() const;
 
   private:
-    std::string      expected_;
+    stream::location loc_;
     char             got_;
+    uint8_t          count_;
+    token            tokens_[capacity];
+  };
+
+  // A diagnostic reported while parsing, for callers that collect them rather
+  // than have them printed.
+  struct diagnostic {
+    diagnostic(stream::location loc, std::string message)
+      : loc(loc), message(message) {
+    }
+
+    stream::location loc;
+    std::string      message;
+  };
+
+  // A saved parser state that can be returned to in constant time. Only the
+  // cursor, the furthest failure and the size of the construct stack are
+  // recorded, so taking one is cheap regardless of how much state has built
+  // up.
+  class checkpoint {
+  public:
+    checkpoint(stream::location loc, const failure &fail, size_t cons,
+               bool valid)
+      : loc_(loc), fail_(fail), cons_(cons), valid_(valid) {
+    }
+
+  private:
+    friend class parser;
+
     stream::location loc_;
+    failure          fail_;
+    size_t           cons_;
+    bool             valid_;
   };
 
   stream &get_stream() { return stream_; }
 
+  // Sets where diagnostics are printed, std::cerr by default.
+  void set_diagnostics(std::ostream &os) { diag_ = &os; diags_ = nullptr; }
+  // Collects diagnostics into the given vector instead of printing them.
+  void set_diagnostics(std::vector<diagnostic> &diags) { diags_ = &diags; }
+
+  // Counts what the parse does into stats, or nothing if it's null, which is
+  // the default.
+  parse_stats *get_stats() const               { return stats_;  }
+  void         set_stats(parse_stats *stats)   { stats_ = stats; }
+
+  // In packrat mode, where each run of a character class ends is remembered
+  // until the next definition, so text that several alternatives look at is
+  // only scanned once and the table never outgrows the largest definition.
+  // Off by default.
+  bool is_packrat()            const { return packrat_;    }
+  void set_packrat(bool packrat)     { packrat_ = packrat; }
+  // Empties the table of runs, in constant time. Parsing definitions does
+  // this before each one.
+  void forget_runs();
+
   bool is_valid()            const { return valid_;  }
   void set_valid(bool valid)       { valid_ = valid; }
 
-  std::set<error> get_errors() const      { return errors_;   }
-  void set_errors(std::set<error> errors) { errors_ = errors; }
+  checkpoint mark() const {
+    return checkpoint(stream_.get_loc(), fail_, cons_.size(), valid_);
+  }
+
+  // Returns to the given checkpoint, dropping any errors reported since.
+  void rollback(const checkpoint &cp);
+  // Returns to the given checkpoint, but keeps the errors reported since so
+  // they can contribute to the diagnostic for a later failure.
+  void backtrack(const checkpoint &cp);
 
-  void add_error(error err);
-  void merge_errors(parser &prs);
-  void clear_errors();
+  // Discards all errors and constructs and makes the parser valid again,
+  // keeping the stream where it is.
+  void reset();
+
+  // Records that t was expected at the cursor.
+  void add_error(token t) {
+    if (stats_)
+      ++stats_->errors_added;
+    fail_.add(t, stream_.peek(), stream_.get_loc());
+  }
+  void clear_errors() {
+    if (stats_ && !fail_.empty())
+      ++stats_->errors_cleared;
+    fail_.clear();
+  }
   // Clears all errors before a specific location in the input stream.
-  void clear_errors(stream::location loc);
+  void clear_errors(stream::location loc) {
+    if (!fail_.empty() && fail_.get_loc().get_offset() < loc.get_offset())
+      clear_errors();
+  }
 
-  void print_error_loc(std::ostream &os, stream::location loc)          const;
-  void print_errors(std::ostream &os)                                   const;
-  void print_error_unterminated(std::ostream &os, stream::location loc) const;
+  void print_error_loc(std::ostream &os, stream::location loc) const;
+
+  // Reports a diagnostic at the given location.
+  void report(stream::location loc, const std::string &message);
+  void report_errors();
+  void report_unterminated(stream::location loc);
 
   void add_construct(construct *c);
 
+  // Sets the module that constructs are made in and names interned in. The
+  // parse functions set it themselves; it only needs setting to run rules
+  // from grammar.h on their own.
+  void set_module(module *mod) { mod_ = mod; }
+
+  // Moves the cursor past the run of scn's class that starts there.
+  void skip_run(const scanner &scn) {
+    if (packrat_)
+      recall_run(scn);
+    else
+      stream_.skip_to(scn.scan(stream_.get_ptr(), stream_.get_end()));
+  }
+
+  // Interns a name in the module being parsed.
+  symbol intern(std::string_view name) {
+    return mod_->get_symbols().intern(name);
+  }
+
+  // Allocates a new construct in the module being parsed.
+  template<typename T, typename... Args>
+  T *make(Args&&... args) {
+    if (stats_)
+      ++stats_->constructs;
+    return mod_->get_arena().make<T>(std::forward<Args>(args)...);
+  }
+
   // Get the construct at the top of the stack and make sure it's of the given
   // type.
   template<typename T>
   T *get_construct() {
-    if (T *t = dyn_cast<T>(cons_.top())) {
-      cons_.pop();
+    if (T *t = dyn_cast<T>(cons_.back())) {
+      cons_.pop_back();
       return t;
     }
     return nullptr;
   }
 
-  // Get the constructs at the top of the stack with the given type.
+  // Get the constructs at the top of the stack with the given type, in the
+  // order they were parsed.
   template<typename T>
-  std::vector<T*> gather_constructs() {
-    std::vector<T*> vec;
-    while (!cons_.empty() && isa<T>(cons_.top())) {
-      T *t = cast<T>(cons_.top()); cons_.pop();
-      vec.push_back(t);
-    }
-    return vec;
+  construct_list<T> gather_constructs() {
+    size_t end = cons_.size(), begin = end;
+    while (begin && isa<T>(cons_[begin - 1]))
+      --begin;
+    T **list = mod_->get_arena().make_array<T*>(end - begin);
+    for (size_t i = begin; i != end; ++i)
+      list[i - begin] = cast<T>(cons_[i]);
+    cons_.resize(begin);
+    return construct_list<T>(list, list + (end - begin));
   }
 
-  // Advances the stream to the next definition.
+  // Advances the stream to the next definition: past the next ';' with
+  // spaces on both sides, or to the next definition head preceded by a
+  // space, which is reported as the start of an unterminated definition, or
+  // to the end. Amortized constant time per call; see find_sync().
   void advance();
-  bool parse();
+  module parse();
+  // Parses the stream in chunks on the given pool. The module and the
+  // diagnostics are the same as with parse().
+  module parse(thread_pool &pool);
+  // Parses the stream as one piece of a longer source. Returns whether the
+  // result stands on its own, i.e. whether parsing the rest of the source
+  // after this piece can't change it. That is the case unless error recovery
+  // ran into the end of the piece.
+  bool parse_piece(module &mod);
+
+  // Returns where the first definition that ends after p most likely ends:
+  // just past a ';' with spaces on both sides and the spaces that follow it,
+  // or end if there is no such ';'. The ';' is looked for from p + 1 on.
+  static const char *find_def_end(const char *p, const char *end);
 
   operator bool() const { return is_valid(); }
 
   template<typename T>
   friend parser& operator>>(parser &prs, T run);
-  friend parser& operator<<(parser &prs, parser new_prs);
 
 private:
-  stream                 stream_;
-  bool                   valid_;
-  std::set<error>        errors_;
-  std::stack<construct*> cons_;
+  parser(const parser&) = delete;
+  parser& operator=(const parser&) = delete;
+
+  // Where a run of a scanner class that was scanned in packrat mode ends.
+  // The key is the offset the run starts at, times four, plus the class's
+  // kind. Only entries of the current generation are live.
+  struct run_entry {
+    run_entry() : key(0), gen(0) { }
+
+    uint64_t         key;
+    uint32_t         gen;
+    stream::location end;
+  };
+
+  // skip_run() in packrat mode: looks the run up, and scans and remembers it
+  // if it isn't there.
+  void recall_run(const scanner &scn);
+  void grow_runs();
+
+  // Returns to the given checkpoint, leaving the furthest failure alone.
+  void restore(const checkpoint &cp);
+
+  // Parses definitions into mod until the end of the stream. If stop is set,
+  // it is given the offset of every definition before it is parsed (provided
+  // nothing is pending from the previous one) and parsing ends if it returns
+  // true.
+  void parse_defs(module &mod, const std::function<bool(size_t)> &stop);
+
+  // A place error recovery can pick up from: a run of spaces starting at
+  // begin and followed by the end of the stream, by a ';' and more spaces
+  // that end at resume, or by a definition head. Offsets before limit
+  // recover to the first place after them. Offsets are into the text the
+  // stream is over, not the whole source.
+  struct sync_point {
+    enum class kind : uint8_t { END, TERMINATOR, HEAD };
+
+    kind   k;
+    size_t begin, limit, resume;
+  };
+
+  // Returns the place recovery from the given offset picks up from. The
+  // places are indexed lazily, a run of spaces at a time, so together the
+  // calls over one parse scan the stream once.
+  const sync_point &find_sync(size_t offset);
+
+  stream                    stream_;
+  bool                      valid_;
+  failure                   fail_;
+  std::vector<construct*>   cons_;
+  std::ostream             *diag_;
+  std::vector<diagnostic>  *diags_;
+  // Set when error recovery runs into the end of the stream. If the stream is
+  // only part of the source, it might have stopped differently given the rest.
+  bool                      hit_eof_;
+  module                   *mod_;
+  parse_stats              *stats_;
+  // The runs remembered in packrat mode: an open-addressed table whose size
+  // is a power of two, how many live entries it has and their generation.
+  bool                      packrat_;
+  std::vector<run_entry>    runs_;
+  size_t                    runs_used_;
+  uint32_t                  runs_gen_;
+  // The places recovery can pick up from, in order, found by indexing the
+  // stream from sync_begin_ up to sync_end_.
+  std::vector<sync_point>   syncs_;
+  size_t                    sync_begin_, sync_end_;
 };
 
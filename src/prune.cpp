@@ -0,0 +1,39 @@
+#include "prune.h"
+#include "callgraph.h"
+
+#include <utility>
+
+bool pruner::run(thread_pool &pool) {
+  const std::vector<construct_def*> &defs = mod_.get_defs();
+  call_graph graph(mod_, pool);
+  before_ = after_ = defs.size();
+
+  std::vector<uint32_t> roots;
+  missing_.clear();
+  for (const std::string &name : entries_) {
+    symbol sym = mod_.get_symbols().lookup(name);
+    uint32_t def = sym.is_valid() ? graph.lookup(sym) : call_graph::none;
+    if (def == call_graph::none)
+      missing_.push_back(name);
+    else
+      roots.push_back(def);
+  }
+  if (!missing_.empty())
+    return false;
+
+  std::vector<bool> reached = graph.get_reachable(roots);
+  std::vector<construct_def*> kept;
+  for (uint32_t i = 0; i != defs.size(); ++i)
+    if (reached[i])
+      kept.push_back(defs[i]);
+  after_ = kept.size();
+  mod_.set_defs(std::move(kept));
+  return true;
+}
+
+void pruner::report(std::ostream &os) const {
+  os << "kept " << after_ << " of " << before_
+     << (before_ == 1 ? " word" : " words") << " reachable from "
+     << entries_.size() << (entries_.size() == 1 ? " entry" : " entries")
+     << "\n";
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "module.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Drops the definitions of a module that no entry word can reach, so later
+// stages don't spend any time on library words nothing uses. A definition is
+// kept if it's an entry or something kept calls it; the ones kept stay in
+// the order they were defined.
+class pruner {
+public:
+  explicit pruner(module &mod) : mod_(mod), before_(0), after_(0) { }
+
+  // Keeps the definition of the given name and everything it calls.
+  void add_entry(const std::string &name) { entries_.push_back(name); }
+
+  // Removes the unreachable definitions, analyzing the calls between them on
+  // the given pool. Returns false without changing the module if an entry
+  // isn't defined in it.
+  bool run(thread_pool &pool);
+
+  // The entries that weren't defined.
+  const std::vector<std::string> &get_missing() const { return missing_; }
+
+  // Writes how many definitions were kept.
+  void report(std::ostream &os) const;
+
+private:
+  pruner(const pruner&) = delete;
+  pruner& operator=(const pruner&) = delete;
+
+  module                  &mod_;
+  std::vector<std::string> entries_, missing_;
+  // The number of definitions before and after.
+  size_t                   before_, after_;
+};
@@ -18,3 +18,21 @@ T *dyn_cast(U *val) {
   return isa<T>(val) ? cast<T>(val) : nullptr;
 }
 
+
+// The same for node handles, which are passed by value. A failed dyn_cast
+// gives a null handle.
+template <typename T, typename U>
+bool isa(const U &val) {
+  return T::classof(val);
+}
+
+template <typename T, typename U>
+T cast(const U &val) {
+  assert(isa<T>(val) && "Invalid cast");
+  return T(val);
+}
+
+template <typename T, typename U>
+T dyn_cast(const U &val) {
+  return isa<T>(val) ? cast<T>(val) : T();
+}
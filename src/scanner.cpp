@@ -1,13 +1,169 @@
 #include "scanner.h"
 
-static bool in_range(char low, char val, char high) {
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86
+#endif
+
+namespace {
+
+struct class_table {
+  bool in[256];
+};
+
+template<typename F>
+constexpr class_table make_table(F fn) {
+  class_table t = {};
+  for (int c = 0; c < 256; ++c)
+    t.in[c] = fn(static_cast<char>(c));
+  return t;
+}
+
+constexpr bool in_range(char low, char val, char high) {
   return low <= val && val <= high;
 }
 
-scanner
-  scanner::is_space("space", [](char c) { return c == ' '  || c == '\n'; }),
-  scanner::is_word("word", [](char c) { return c && !is_space(c); }),
-  scanner::is_ident("identifier", [](char c) {
-    return in_range('a', c, 'z') || in_range('A', c, 'Z') ||
-           in_range('0', c, '9') || c == '_'; });
+constexpr bool space(char c) { return c == ' ' || c == '\n'; }
+
+constexpr class_table space_table = make_table(space);
+constexpr class_table word_table = make_table([](char c) {
+  return c && !space(c); });
+constexpr class_table ident_table = make_table([](char c) {
+  return in_range('a', c, 'z') || in_range('A', c, 'Z') ||
+         in_range('0', c, '9') || c == '_'; });
+
+const char *scan_scalar(const bool *table, const char *p, const char *end) {
+  while (p != end && table[static_cast<unsigned char>(*p)])
+    ++p;
+  return p;
+}
+
+#ifdef SCANNER_X86
+
+// The vector loops below compute, for each block of bytes, a bitmask of the
+// bytes that are *not* in the class; the run ends at its lowest set bit. A
+// byte x is in [lo, hi] when (x - lo) <= (hi - lo) as unsigned bytes, which is
+// when max(x - lo, hi - lo) == hi - lo.
+
+__attribute__((target("sse2")))
+__m128i in_range_sse2(__m128i x, char lo, char hi) {
+  __m128i bound = _mm_set1_epi8(hi - lo);
+  __m128i off = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_max_epu8(off, bound), bound);
+}
+
+__attribute__((target("avx2")))
+__m256i in_range_avx2(__m256i x, char lo, char hi) {
+  __m256i bound = _mm256_set1_epi8(hi - lo);
+  __m256i off = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_max_epu8(off, bound), bound);
+}
+
+template<scanner::kind K>
+__attribute__((target("sse2")))
+unsigned miss_mask_sse2(__m128i x) {
+  __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                               _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+  __m128i hit;
+  switch (K) {
+  case scanner::kind::SPACE:
+    hit = space;
+    break;
+  case scanner::kind::WORD:
+    hit = _mm_xor_si128(
+      _mm_or_si128(space, _mm_cmpeq_epi8(x, _mm_setzero_si128())),
+      _mm_set1_epi8(-1));
+    break;
+  case scanner::kind::IDENT:
+    hit = _mm_or_si128(
+      _mm_or_si128(in_range_sse2(_mm_or_si128(x, _mm_set1_epi8(0x20)),
+                                 'a', 'z'),
+                   in_range_sse2(x, '0', '9')),
+      _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+    break;
+  }
+  return ~static_cast<unsigned>(_mm_movemask_epi8(hit)) & 0xffff;
+}
+
+template<scanner::kind K>
+__attribute__((target("avx2")))
+unsigned miss_mask_avx2(__m256i x) {
+  __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+  __m256i hit;
+  switch (K) {
+  case scanner::kind::SPACE:
+    hit = space;
+    break;
+  case scanner::kind::WORD:
+    hit = _mm256_xor_si256(
+      _mm256_or_si256(space, _mm256_cmpeq_epi8(x, _mm256_setzero_si256())),
+      _mm256_set1_epi8(-1));
+    break;
+  case scanner::kind::IDENT:
+    hit = _mm256_or_si256(
+      _mm256_or_si256(
+        in_range_avx2(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z'),
+        in_range_avx2(x, '0', '9')),
+      _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+    break;
+  }
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(hit));
+}
+
+template<scanner::kind K>
+__attribute__((target("sse2")))
+const char *scan_sse2(const bool *table, const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if (unsigned miss = miss_mask_sse2<K>(x))
+      return p + __builtin_ctz(miss);
+  }
+  return scan_scalar(table, p, end);
+}
+
+template<scanner::kind K>
+__attribute__((target("avx2")))
+const char *scan_avx2(const bool *table, const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    if (unsigned miss = miss_mask_avx2<K>(x))
+      return p + __builtin_ctz(miss);
+  }
+  return scan_sse2<K>(table, p, end);
+}
+
+typedef const char *(*scan_fn_ty)(const bool*, const char*, const char*);
+
+template<scanner::kind K>
+scan_fn_ty select_scan() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? scan_avx2<K> : scan_sse2<K>;
+}
+
+const scan_fn_ty scan_space = select_scan<scanner::kind::SPACE>(),
+                 scan_ident = select_scan<scanner::kind::IDENT>(),
+                 scan_word  = select_scan<scanner::kind::WORD>();
+
+#endif // SCANNER_X86
+
+} // end anonymous namespace
+
+const char *scanner::scan(const char *begin, const char *end) const {
+  // Most runs are short, so settle those before paying for a vector load.
+  if (begin == end || !(*this)(*begin))
+    return begin;
+#ifdef SCANNER_X86
+  switch (kind_) {
+  case kind::SPACE: return scan_space(table_, begin, end);
+  case kind::IDENT: return scan_ident(table_, begin, end);
+  case kind::WORD:  return scan_word(table_, begin, end);
+  }
+#endif
+  return scan_scalar(table_, begin, end);
+}
 
+const scanner
+  scanner::is_space("space", scanner::kind::SPACE, space_table.in),
+  scanner::is_word("word", scanner::kind::WORD, word_table.in),
+  scanner::is_ident("identifier", scanner::kind::IDENT, ident_table.in);
@@ -1,21 +1,31 @@
 #pragma once
 
-#include <functional>
-
+// A character class. Membership is a lookup in a 256-entry table, and whole
+// runs of the class can be skipped in bulk with scan().
 class scanner {
 public:
-  scanner(const char *id, std::function<bool(char)> fn)
-    : id_(id), fn_(fn) {
+  // The classes the bulk scanner has vectorized loops for.
+  enum class kind { SPACE, IDENT, WORD };
+
+  constexpr scanner(const char *id, kind k, const bool *table)
+    : id_(id), kind_(k), table_(table) {
   }
 
-  const char *get_id() const { return id_; }
+  const char *get_id()   const { return id_;   }
+  kind        get_kind() const { return kind_; }
 
-  bool operator()(char c) const { return fn_(c); }
+  bool operator()(char c) const {
+    return table_[static_cast<unsigned char>(c)];
+  }
 
-  static scanner is_space, is_ident, is_word;
+  // Returns the end of the run of characters from the class that starts at
+  // begin, looking no further than end.
+  const char *scan(const char *begin, const char *end) const;
+
+  static const scanner is_space, is_ident, is_word;
 
 private:
   const char *id_;
-  std::function<bool(char)> fn_;
+  kind        kind_;
+  const bool *table_;
 };
-
@@ -0,0 +1,231 @@
+#include "server.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+
+// JSON-RPC error codes.
+static const int parse_error      = -32700;
+static const int invalid_request  = -32600;
+static const int method_not_found = -32601;
+static const int invalid_params   = -32602;
+
+// The text document sync kind for incremental changes.
+static const int sync_incremental = 2;
+
+bool server::read_message(std::string &body) {
+  size_t length = 0;
+  bool has_length = false;
+  for (std::string line; std::getline(in_, line);) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty()) {
+      if (has_length)
+        break;
+      continue;
+    }
+    static const char header[] = "Content-Length:";
+    if (line.compare(0, sizeof(header) - 1, header) == 0) {
+      length = std::strtoul(line.c_str() + sizeof(header) - 1, nullptr, 10);
+      has_length = true;
+    }
+  }
+  if (!in_)
+    return false;
+
+  body.resize(length);
+  in_.read(&body[0], length);
+  return static_cast<size_t>(in_.gcount()) == length;
+}
+
+void server::send(const json &msg) {
+  buf_.clear();
+  msg.write(buf_);
+  out_ << "Content-Length: " << buf_.size() << "\r\n\r\n";
+  out_.write(buf_.data(), buf_.size());
+  out_.flush();
+}
+
+void server::reply(const json &id, json result) {
+  json msg = json::object();
+  msg.set("jsonrpc", "2.0");
+  msg.set("id", id);
+  msg.set("result", std::move(result));
+  send(msg);
+}
+
+void server::reply_error(const json &id, int code, const char *message) {
+  json err = json::object();
+  err.set("code", code);
+  err.set("message", message);
+  json msg = json::object();
+  msg.set("jsonrpc", "2.0");
+  msg.set("id", id);
+  msg.set("error", std::move(err));
+  send(msg);
+}
+
+// Converts a zero-based protocol position to a document position. Lines and
+// columns too big for one are taken to mean the end of the text or the line.
+// Returns false if either isn't a number or is negative.
+static bool get_position(const json &pos, document::position &out) {
+  const json &line = pos["line"], &col = pos["character"];
+  if (!line.is_number() || !col.is_number())
+    return false;
+  // Written so NaN fails too.
+  double l = line.get_number(), c = col.get_number();
+  if (!(l >= 0) || !(c >= 0))
+    return false;
+  const double max = UINT_MAX - 1;
+  out = document::position(unsigned(std::min(l, max)) + 1,
+                           unsigned(std::min(c, max)) + 1);
+  return true;
+}
+
+static json make_position(unsigned line, unsigned col) {
+  json pos = json::object();
+  pos.set("line", line - 1);
+  pos.set("character", col - 1);
+  return pos;
+}
+
+void server::did_open(const json &params) {
+  const json &doc = params["textDocument"];
+  const std::string &uri = doc["uri"].get_string();
+  docs_.erase(uri);
+  docs_.emplace(uri, document(uri, doc["text"].get_string()));
+  publish(uri);
+}
+
+bool server::did_change(const json &params) {
+  const std::string &uri = params["textDocument"]["uri"].get_string();
+  auto it = docs_.find(uri);
+  if (it == docs_.end())
+    return true;
+
+  // Changes apply one after the other, each to the text the last one left,
+  // so all of them are checked before any is applied.
+  const json::array_t &changes = params["contentChanges"].get_array();
+  std::vector<document::position> ranges;
+  for (const json &change : changes) {
+    const json &range = change["range"];
+    if (range.is_null())
+      continue;
+    document::position begin(1, 1), end(1, 1);
+    if (!get_position(range["start"], begin) ||
+        !get_position(range["end"], end))
+      return false;
+    ranges.push_back(begin);
+    ranges.push_back(end);
+  }
+
+  auto pos = ranges.begin();
+  for (const json &change : changes) {
+    if (change["range"].is_null()) {
+      it->second.set_text(change["text"].get_string());
+    } else {
+      it->second.edit(pos[0], pos[1], change["text"].get_string());
+      pos += 2;
+    }
+  }
+  publish(uri);
+  return true;
+}
+
+void server::did_close(const json &params) {
+  const std::string &uri = params["textDocument"]["uri"].get_string();
+  docs_.erase(uri);
+  publish(uri);
+}
+
+void server::publish(const std::string &uri) {
+  std::vector<document::diagnostic> diags;
+  auto it = docs_.find(uri);
+  if (it != docs_.end())
+    it->second.get_diagnostics(diags);
+
+  json list = json::array();
+  for (const document::diagnostic &d : diags) {
+    // Point at the single character the error was found at.
+    unsigned line = d.pos.line, col = d.pos.col;
+    json range = json::object();
+    range.set("start", make_position(line, col));
+    range.set("end", make_position(line, col + 1));
+
+    json diag = json::object();
+    diag.set("range", std::move(range));
+    diag.set("severity", 1);
+    diag.set("source", "wildcat");
+    diag.set("message", d.message);
+    list.push(std::move(diag));
+  }
+
+  json params = json::object();
+  params.set("uri", uri);
+  params.set("diagnostics", std::move(list));
+  json msg = json::object();
+  msg.set("jsonrpc", "2.0");
+  msg.set("method", "textDocument/publishDiagnostics");
+  msg.set("params", std::move(params));
+  send(msg);
+}
+
+void server::handle(const json &msg) {
+  const json &id = msg["id"];
+  const json &method = msg["method"];
+  if (!method.is_string()) {
+    // Responses to requests of ours; we make none.
+    if (!msg["result"].is_null() || !msg["error"].is_null())
+      return;
+    reply_error(id, invalid_request, "Invalid request");
+    return;
+  }
+
+  const std::string &name = method.get_string();
+  const json &params = msg["params"];
+  if (name == "initialize") {
+    json sync = json::object();
+    sync.set("openClose", true);
+    sync.set("change", sync_incremental);
+    json caps = json::object();
+    // Columns are counted in bytes.
+    caps.set("positionEncoding", "utf-8");
+    caps.set("textDocumentSync", std::move(sync));
+    json info = json::object();
+    info.set("name", "wildcat");
+    json result = json::object();
+    result.set("capabilities", std::move(caps));
+    result.set("serverInfo", std::move(info));
+    reply(id, std::move(result));
+  } else if (name == "shutdown") {
+    shutdown_ = true;
+    reply(id, json());
+  } else if (name == "exit") {
+    exit_ = true;
+  } else if (name == "textDocument/didOpen") {
+    did_open(params);
+  } else if (name == "textDocument/didChange") {
+    if (!did_change(params))
+      reply_error(id, invalid_params, "Invalid params");
+  } else if (name == "textDocument/didClose") {
+    did_close(params);
+  } else if (!id.is_null()) {
+    // Notifications we don't know are ignored, requests get an error.
+    reply_error(id, method_not_found, "Method not found");
+  }
+}
+
+int server::run() {
+  std::string body;
+  while (!exit_ && read_message(body)) {
+    json msg;
+    if (!json::parse(body, msg) || !msg.is_object()) {
+      reply_error(json(), parse_error, "Parse error");
+      continue;
+    }
+    handle(msg);
+  }
+  return shutdown_ ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "document.h"
+#include "json.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+// Serves diagnostics to an editor over the Language Server Protocol: JSON-RPC
+// messages, each preceded by a Content-Length header, read from one stream and
+// written to another. Open documents stay parsed in memory between messages,
+// and changes to them are applied as incremental edits.
+class server {
+public:
+  server(std::istream &in, std::ostream &out)
+    : in_(in), out_(out), shutdown_(false), exit_(false) {
+  }
+
+  // Serves messages until the client asks us to exit or closes the input.
+  // Returns the exit status: 0 if the client shut us down first, 1 otherwise.
+  int run();
+
+private:
+  server(const server&) = delete;
+  server& operator=(const server&) = delete;
+
+  // Reads the body of the next message. Returns false at the end of input.
+  bool read_message(std::string &body);
+
+  void send(const json &msg);
+  void reply(const json &id, json result);
+  void reply_error(const json &id, int code, const char *message);
+
+  void handle(const json &msg);
+  void did_open(const json &params);
+  // Returns false, without changing the document, if a change's range is
+  // malformed.
+  bool did_change(const json &params);
+  void did_close(const json &params);
+
+  // Sends the diagnostics for the open document with the given URI, or an
+  // empty set if it has been closed.
+  void publish(const std::string &uri);
+
+  std::istream                              &in_;
+  std::ostream                              &out_;
+  std::unordered_map<std::string, document>  docs_;
+  // The buffer messages are serialized into, kept to reuse its storage.
+  std::string                                buf_;
+  bool                                       shutdown_, exit_;
+};
@@ -0,0 +1,196 @@
+#include "shuffle.h"
+
+#include <algorithm>
+
+namespace {
+
+// A stack primitive, the instruction that does it and what it does.
+struct primitive {
+  const char  *name;
+  program::op  op;
+  shuffle      shuf;
+};
+
+const primitive primitives[] = {
+  { "dup",  program::op::DUP,  shuffle(1, { 0, 0 })    },
+  { "drop", program::op::DROP, shuffle(1, { })         },
+  { "swap", program::op::SWAP, shuffle(2, { 1, 0 })    },
+  { "rot",  program::op::ROT,  shuffle(3, { 1, 2, 0 }) },
+  { "over", program::op::OVER, shuffle(2, { 0, 1, 0 }) },
+  { "nip",  program::op::NIP,  shuffle(2, { 1 })       },
+  { "tuck", program::op::TUCK, shuffle(2, { 1, 0, 1 }) },
+  { "-rot", program::op::NROT, shuffle(3, { 2, 0, 1 }) },
+};
+
+uint32_t count_inputs(const construct_type_fn *type) {
+  uint32_t n = 0;
+  for (construct_type_compound *c : type->get_inp()->get_list())
+    n += c->get_list().size();
+  return n;
+}
+
+} // end anonymous namespace
+
+shuffle::shuffle(uint32_t n) : inputs_(n) {
+  for (uint32_t i = 0; i != n; ++i)
+    outputs_.push_back(i);
+}
+
+bool shuffle::then(const shuffle &s) {
+  size_t have = outputs_.size();
+  uint32_t extra = s.inputs_ > have ? s.inputs_ - have : 0;
+  if (inputs_ + extra > max_size ||
+      have + extra - s.inputs_ + s.outputs_.size() > max_size)
+    return false;
+
+  if (extra) {
+    for (uint8_t &o : outputs_)
+      o += extra;
+    for (uint32_t i = 0; i != extra; ++i)
+      outputs_.insert(outputs_.begin() + i, i);
+    inputs_ += extra;
+  }
+
+  size_t base = outputs_.size() - s.inputs_;
+  std::vector<uint8_t> top(outputs_.begin() + base, outputs_.end());
+  outputs_.resize(base);
+  for (uint8_t o : s.outputs_)
+    outputs_.push_back(top[o]);
+  return true;
+}
+
+void shuffle::trim() {
+  size_t n = 0;
+  while (n != inputs_ && n != outputs_.size() && outputs_[n] == n &&
+         std::count(outputs_.begin(), outputs_.end(), n) == 1)
+    ++n;
+  if (!n)
+    return;
+  outputs_.erase(outputs_.begin(), outputs_.begin() + n);
+  for (uint8_t &o : outputs_)
+    o -= n;
+  inputs_ -= n;
+}
+
+void shuffle::emit(program &prog) const {
+  if (inputs_ == 0 && outputs_.empty())
+    return;
+  for (const primitive &p : primitives)
+    if (p.shuf == *this) {
+      prog.emit(p.op);
+      return;
+    }
+  prog.emit(program::op::SHUFFLE);
+  prog.emit_u8(inputs_);
+  prog.emit_u8(outputs_.size());
+  for (uint8_t o : outputs_)
+    prog.emit_u8(o);
+}
+
+const shuffle *shuffle::find_primitive(std::string_view name) {
+  for (const primitive &p : primitives)
+    if (name == p.name)
+      return &p.shuf;
+  return nullptr;
+}
+
+shuffle_table::frame::frame(const construct_def *d)
+  : def(d), pos(0), ok(true) {
+  uint32_t inputs = count_inputs(def->get_type());
+  for (construct_arg_compound *c : def->get_args()->get_list())
+    for (construct_arg_id *id : c->get_list())
+      args.push_back(id->get_sym());
+  if (inputs > shuffle::max_size ||
+      (!args.empty() && args.size() != inputs)) {
+    ok = false;
+    return;
+  }
+  // A body with arguments starts out with none of its inputs on the stack;
+  // one without starts out with all of them.
+  shuf = args.empty() ? shuffle(inputs) : shuffle(inputs, { });
+}
+
+symbol shuffle_table::resume(frame &f) const {
+  construct_list<construct_word> body = f.def->get_body()->get_list();
+  for (; f.ok && f.pos != body.size(); ++f.pos) {
+    symbol sym = body[f.pos]->get_sym();
+
+    auto arg = std::find(f.args.rbegin(), f.args.rend(), sym);
+    if (arg != f.args.rend()) {
+      f.ok = f.shuf.get_outputs().size() != shuffle::max_size;
+      if (f.ok)
+        f.shuf.push(f.args.rend() - arg - 1);
+      continue;
+    }
+
+    const shuffle *s = nullptr;
+    const entry &e = entries_[sym.get_id()];
+    if (e.def) {
+      if (e.st == state::UNKNOWN)
+        return sym;
+      if (e.st == state::SHUFFLE)
+        s = &e.shuf;
+    } else {
+      s = shuffle::find_primitive(syms_->get_name(sym));
+    }
+    // Whatever's called can't reach below where the body started.
+    f.ok = s && s->get_inputs() <= f.shuf.get_outputs().size() &&
+           f.shuf.then(*s);
+  }
+  return symbol();
+}
+
+void shuffle_table::analyze(const module &mod) {
+  syms_ = &mod.get_symbols();
+  entries_.assign(syms_->size(), entry());
+  for (const construct_def *def : mod.get_defs()) {
+    entry &e = entries_[def->get_name()->get_sym().get_id()];
+    if (!e.def)
+      e.def = def;
+  }
+
+  // The bodies are worked through depth first, on a stack of our own so a
+  // long chain of calls to later definitions can't overflow the real one.
+  std::vector<frame> frames;
+  for (const construct_def *def : mod.get_defs()) {
+    entry &root = entries_[def->get_name()->get_sym().get_id()];
+    if (root.st != state::UNKNOWN)
+      continue;
+    root.st = state::VISITING;
+    frames.emplace_back(root.def);
+
+    while (!frames.empty()) {
+      symbol next = resume(frames.back());
+      if (next.is_valid()) {
+        entry &e = entries_[next.get_id()];
+        e.st = state::VISITING;
+        frames.emplace_back(e.def);
+        continue;
+      }
+
+      frame &f = frames.back();
+      entry &e = entries_[f.def->get_name()->get_sym().get_id()];
+      size_t outputs = f.def->get_type()->get_out()->get_list().size();
+      if (f.ok && f.shuf.get_outputs().size() == outputs) {
+        e.st = state::SHUFFLE;
+        e.shuf = std::move(f.shuf);
+      } else {
+        e.st = state::OTHER;
+      }
+      frames.pop_back();
+    }
+  }
+}
+
+const shuffle *shuffle_table::lookup(symbol sym) const {
+  if (sym.get_id() >= entries_.size())
+    return nullptr;
+  const entry &e = entries_[sym.get_id()];
+  return e.st == state::SHUFFLE ? &e.shuf : nullptr;
+}
+
+const shuffle *shuffle_table::lookup(const construct_def *def) const {
+  const shuffle *s = lookup(def->get_name()->get_sym());
+  return s && entries_[def->get_name()->get_sym().get_id()].def == def ?
+         s : nullptr;
+}
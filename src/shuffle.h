@@ -0,0 +1,103 @@
+#pragma once
+
+#include "bytecode.h"
+#include "construct.h"
+#include "module.h"
+#include "symbol.h"
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A rearrangement of the values on top of the stack. It takes get_inputs()
+// values and leaves, from the bottom up, copies of the inputs whose indices
+// are in get_outputs(). An input that isn't left is dropped, one left more
+// than once is duplicated.
+class shuffle {
+public:
+  // The most values a shuffle can take or leave, so it fits in a SHUFFLE.
+  static const uint32_t max_size = UINT8_MAX;
+
+  // The shuffle that takes n values and leaves them where they are.
+  explicit shuffle(uint32_t n = 0);
+  shuffle(uint32_t inputs, std::vector<uint8_t> outputs)
+    : inputs_(inputs), outputs_(std::move(outputs)) { }
+
+  uint32_t                    get_inputs()  const { return inputs_;  }
+  const std::vector<uint8_t> &get_outputs() const { return outputs_; }
+
+  bool operator==(const shuffle &s) const {
+    return inputs_ == s.inputs_ && outputs_ == s.outputs_;
+  }
+
+  // Leaves another copy of the given input on top.
+  void push(uint8_t input) { outputs_.push_back(input); }
+
+  // Follows this shuffle with s. If s takes more values than this leaves,
+  // this is widened to pass the ones below through first. Returns false,
+  // leaving this alone, if the result would be bigger than max_size.
+  bool then(const shuffle &s);
+
+  // Stops taking the bottom inputs that would be left where they are.
+  void trim();
+
+  // Emits the fewest instructions that do this shuffle, which should be
+  // trimmed; nothing at all for the identity.
+  void emit(program &prog) const;
+
+  // Returns the shuffle the stack primitive with the given name does, or
+  // null if there's none.
+  static const shuffle *find_primitive(std::string_view name);
+
+private:
+  uint32_t             inputs_;
+  std::vector<uint8_t> outputs_;
+};
+
+// Works out which definitions of a module are shuffles: those whose bodies
+// only name their arguments, as in "rot : (a b c -> b c a) (a b c) ->
+// b c a", or only stack primitives and other shuffles, as in "-rot : (a b c
+// -> c a b) -> rot rot". Only the first definition of a name counts, like
+// in the compiler, and recursive ones never are shuffles.
+class shuffle_table {
+public:
+  shuffle_table() : syms_(nullptr) { }
+
+  void analyze(const module &mod);
+
+  // Returns what the definition does if it's a shuffle, null otherwise.
+  const shuffle *lookup(symbol sym) const;
+  const shuffle *lookup(const construct_def *def) const;
+
+private:
+  // A body part of the way through being worked out.
+  struct frame {
+    explicit frame(const construct_def *def);
+
+    const construct_def *def;
+    size_t               pos;
+    shuffle              shuf;
+    std::vector<symbol>  args;
+    bool                 ok;
+  };
+
+  // Goes on through the body in f, up to its end or a word that means it
+  // isn't a shuffle, which clears f.ok. Stops early at a call to a
+  // definition that isn't worked out yet and returns its name; otherwise
+  // returns an invalid symbol.
+  symbol resume(frame &f) const;
+
+  enum class state : uint8_t { UNKNOWN, VISITING, SHUFFLE, OTHER };
+
+  struct entry {
+    entry() : def(nullptr), st(state::UNKNOWN) { }
+
+    const construct_def *def;
+    state                st;
+    shuffle              shuf;
+  };
+
+  const symbol_table *syms_;
+  std::vector<entry>  entries_;
+};
@@ -0,0 +1,81 @@
+#include "stats.h"
+
+#include <cstdio>
+
+#include <sys/resource.h>
+
+const char *parse_stats::get_name(rule r) {
+  static const char *const names[] = {
+    "parse_many", "parse_spaces", "parse_maybe_spaces", "parse_eof",
+    "parse_comma_sep", "parse_space_sep", "parse_id", "parse_word",
+    "parse_type_id", "parse_type_compound", "parse_type_list",
+    "parse_type_fn", "parse_arg_id", "parse_arg_compound", "parse_arg_list",
+    "parse_args", "parse_body", "parse_def", "parse_char", "parse_string",
+  };
+  static_assert(sizeof(names) / sizeof(*names) ==
+                static_cast<size_t>(rule::COUNT), "A rule has no name");
+  return names[static_cast<size_t>(r)];
+}
+
+void parse_stats::scope::start() {
+  begin_ = std::chrono::steady_clock::now();
+}
+
+void parse_stats::scope::stop() {
+  rule_stats &s = stats_->rules_[static_cast<size_t>(rule_)];
+  ++s.calls;
+  s.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - begin_).count();
+}
+
+void parse_stats::merge(const parse_stats &other) {
+  for (size_t i = 0; i != static_cast<size_t>(rule::COUNT); ++i) {
+    rules_[i].calls += other.rules_[i].calls;
+    rules_[i].nanos += other.rules_[i].nanos;
+  }
+  rollbacks += other.rollbacks;
+  backtracks += other.backtracks;
+  constructs += other.constructs;
+  errors_added += other.errors_added;
+  errors_cleared += other.errors_cleared;
+  advances += other.advances;
+  skipped += other.skipped;
+  runs_recalled += other.runs_recalled;
+}
+
+void parse_stats::report(std::ostream &os) const {
+  char line[80];
+  // Times include the rules run from inside each one.
+  std::snprintf(line, sizeof(line), "  %-20s %12s %12s\n", "rule", "calls",
+                "ms");
+  os << line;
+  for (size_t i = 0; i != static_cast<size_t>(rule::COUNT); ++i) {
+    if (!rules_[i].calls)
+      continue;
+    std::snprintf(line, sizeof(line), "  %-20s %12llu ",
+                  get_name(static_cast<rule>(i)),
+                  static_cast<unsigned long long>(rules_[i].calls));
+    os << line;
+    // The smallest rules are only counted.
+    if (rules_[i].nanos)
+      std::snprintf(line, sizeof(line), "%12.3f\n", rules_[i].nanos / 1e6);
+    else
+      std::snprintf(line, sizeof(line), "%12s\n", "-");
+    os << line;
+  }
+  os << "  rollbacks " << rollbacks << ", backtracks " << backtracks
+     << ", constructs " << constructs << "\n"
+     << "  errors added " << errors_added << ", errors cleared "
+     << errors_cleared << "\n"
+     << "  advances " << advances << ", characters skipped " << skipped
+     << "\n";
+  if (runs_recalled)
+    os << "  runs recalled " << runs_recalled << "\n";
+}
+
+void report_peak_rss(std::ostream &os) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    // Linux reports kilobytes.
+    os << "peak RSS: " << usage.ru_maxrss << " KB\n";
+}
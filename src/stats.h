@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Counters for profiling a parse: how often each rule ran and for how long,
+// and how much backtracking, allocation and error recovery it took. Parsers
+// only keep counts when given a parse_stats, so they cost a test of a null
+// pointer otherwise.
+class parse_stats {
+public:
+  // The rules in grammar.h and combinator.h that are counted.
+  enum class rule : uint8_t {
+    MANY, SPACES, MAYBE_SPACES, END, COMMA_SEP, SPACE_SEP, ID, WORD,
+    TYPE_ID, TYPE_COMPOUND, TYPE_LIST, TYPE_FN, ARG_ID, ARG_COMPOUND,
+    ARG_LIST, ARGS, BODY, DEF, CHAR, STRING, COUNT
+  };
+
+  static const char *get_name(rule r);
+
+  parse_stats()
+    : rollbacks(0), backtracks(0), constructs(0), errors_added(0),
+      errors_cleared(0), advances(0), skipped(0), runs_recalled(0) {
+  }
+
+  // Times one run of a rule, counting it against stats if that's set. The
+  // counting is kept out of line so the rules stay small when it's off.
+  class scope {
+  public:
+    scope(parse_stats *stats, rule r) : stats_(stats), rule_(r) {
+      if (__builtin_expect(stats_ != nullptr, 0))
+        start();
+    }
+
+    ~scope() {
+      if (__builtin_expect(stats_ != nullptr, 0))
+        stop();
+    }
+
+  private:
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    __attribute__((cold, noinline)) void start();
+    __attribute__((cold, noinline)) void stop();
+
+    parse_stats                          *stats_;
+    rule                                  rule_;
+    std::chrono::steady_clock::time_point begin_;
+  };
+
+  // Counts a run of a rule against stats, if that's set, without timing it.
+  // Used for the smallest rules, which timing would slow down even when off.
+  static void count(parse_stats *stats, rule r) {
+    if (__builtin_expect(stats != nullptr, 0))
+      ++stats->rules_[static_cast<size_t>(r)].calls;
+  }
+
+  // Adds the other stats' counts to these.
+  void merge(const parse_stats &other);
+
+  // Writes a table of the rules that ran, then the other counts.
+  void report(std::ostream &os) const;
+
+  // Failed rules undone with maybe(), and with do_try().
+  uint64_t rollbacks, backtracks;
+  // Constructs made in the module's arena.
+  uint64_t constructs;
+  // Expected tokens recorded, and failures forgotten once parsing got past
+  // them.
+  uint64_t errors_added, errors_cleared;
+  // Calls to parser::advance() after an error, and the characters they
+  // skipped.
+  uint64_t advances, skipped;
+  // Runs of a character class looked up instead of scanned, in packrat mode.
+  uint64_t runs_recalled;
+
+private:
+  struct rule_stats {
+    rule_stats() : calls(0), nanos(0) { }
+
+    uint64_t calls, nanos;
+  };
+
+  rule_stats rules_[static_cast<size_t>(rule::COUNT)];
+};
+
+// Writes the peak resident set size of the process so far.
+void report_peak_rss(std::ostream &os);
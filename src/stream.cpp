@@ -1,20 +1,198 @@
 #include "stream.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <utility>
 
-char stream::next() {
-  char c = peek();
-  if (c) {
-    unsigned col = loc_.get_col(), line = loc_.get_line();
-    loc_ = location(c == '\n' ? 1 : col + 1,  c == '\n' ? line + 1 : line);
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STREAM_X86
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+typedef void (*index_fn_ty)(const char*, const char*, const char*,
+                            std::vector<size_t>&);
+
+// Appends the offset from base of the character after every line break in
+// [p, end) to starts.
+void index_scalar(const char *base, const char *p, const char *end,
+                  std::vector<size_t> &starts) {
+  while ((p = static_cast<const char*>(std::memchr(p, '\n', end - p))))
+    starts.push_back(++p - base);
+}
+
+#ifdef STREAM_X86
+
+// The same, a block of bytes at a time: a mask of the line breaks in the
+// block, then one entry per set bit. Blocks without a break, which are most
+// of them, cost a compare and a test.
+
+__attribute__((target("sse2")))
+void index_sse2(const char *base, const char *p, const char *end,
+                std::vector<size_t> &starts) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    for (unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, nl)); m;
+         m &= m - 1)
+      starts.push_back(p - base + __builtin_ctz(m) + 1);
+  }
+  index_scalar(base, p, end, starts);
+}
+
+__attribute__((target("avx2")))
+void index_avx2(const char *base, const char *p, const char *end,
+                std::vector<size_t> &starts) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    for (unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, nl)); m;
+         m &= m - 1)
+      starts.push_back(p - base + __builtin_ctz(m) + 1);
+  }
+  index_sse2(base, p, end, starts);
+}
+
+index_fn_ty select_index() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? index_avx2 : index_sse2;
+}
+
+const index_fn_ty index_lines = select_index();
+
+#else
+
+const index_fn_ty index_lines = index_scalar;
+
+#endif // STREAM_X86
+
+} // end anonymous namespace
+
+stream::position stream::position::advance(const char *begin,
+                                           const char *end) const {
+  const char *last_nl = nullptr;
+  uint64_t line = line_;
+  for (const char *it = begin;
+       (it = static_cast<const char*>(std::memchr(it, '\n', end - it)));
+       last_nl = it++)
+    ++line;
+  return position(line, last_nl ? end - last_nl : col_ + (end - begin));
+}
+
+stream::buffer::~buffer() {
+  if (mapped_)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+bool stream::buffer::map(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(addr);
+      size_ = st.st_size;
+      mapped_ = true;
+      close(fd);
+      return true;
+    }
   }
-  return c;
+
+  // Not mappable, read it into a single owned buffer instead.
+  std::string text;
+  char chunk[1 << 16];
+  for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) > 0;)
+    text.append(chunk, n);
+  close(fd);
+  own(text);
+  return true;
+}
+
+void stream::buffer::own(std::string text) {
+  owned_.swap(text);
+  data_ = owned_.data();
+  size_ = owned_.size();
+}
+
+const std::vector<size_t> &stream::buffer::get_line_starts() const {
+  std::call_once(lines_once_, [this] {
+    index_lines(data_, data_, data_ + size_, line_starts_);
+  });
+  return line_starts_;
+}
+
+stream::stream(const char *filename)
+  : filename_(filename), origin_pos_(1, 1) {
+  std::shared_ptr<buffer> buf = std::make_shared<buffer>();
+  buf->map(filename);
+  buf_ = buf;
+  init();
 }
 
-char stream::peek() const {
-  unsigned col = loc_.get_col(), line = loc_.get_line();
-  if (col == lines_.at(line - 1).size() + 1)
-    return line == lines_.size() ? '\0' : '\n';
-  return lines_.at(line - 1).at(col - 1);
+stream::stream(const char *filename, std::string text)
+  : stream(filename, std::move(text), location(0), position(1, 1)) {
 }
 
+stream::stream(const char *filename, std::string text, location origin,
+               position origin_pos)
+  : filename_(filename), origin_(origin), origin_pos_(origin_pos) {
+  std::shared_ptr<buffer> buf = std::make_shared<buffer>();
+  buf->own(std::move(text));
+  buf_ = buf;
+  init();
+}
+
+void stream::init() {
+  begin_ = cur_ = buf_->get_data();
+  end_ = begin_ + buf_->get_size();
+  // Like std::getline, a single trailing newline ends the last line rather
+  // than starting a new, empty one.
+  if (begin_ != end_ && end_[-1] == '\n')
+    --end_;
+  limit_ = end_;
+}
+
+stream stream::slice(location begin, uint64_t end) const {
+  stream s(*this);
+  s.set_loc(begin);
+  s.end_ = begin_ + (end - origin_.get_offset());
+  return s;
+}
+
+stream::position stream::get_position(location loc) const {
+  const std::vector<size_t> &starts = buf_->get_line_starts();
+  size_t at = loc.get_offset() - origin_.get_offset();
+  size_t n = std::upper_bound(starts.begin(), starts.end(), at) -
+             starts.begin();
+  // The first line may have started before the text did.
+  if (n == 0)
+    return position(origin_pos_.get_line(), origin_pos_.get_col() + at);
+  return position(origin_pos_.get_line() + n, at - starts[n - 1] + 1);
+}
+
+stream::location stream::get_line_begin(location loc) const {
+  const std::vector<size_t> &starts = buf_->get_line_starts();
+  size_t at = loc.get_offset() - origin_.get_offset();
+  auto it = std::upper_bound(starts.begin(), starts.end(), at);
+  return location(origin_.get_offset() +
+                  (it == starts.begin() ? 0 : it[-1]));
+}
+
+std::string stream::get_line(location loc) const {
+  const char *it = begin_ + (get_line_begin(loc).get_offset() -
+                             origin_.get_offset());
+  const char *e = it;
+  while (e != limit_ && *e != '\n')
+    ++e;
+  return std::string(it, e);
+}
@@ -1,62 +1,159 @@
 #pragma once
 
-#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class stream {
 public:
-  stream(const char *filename)
-    : filename_(filename), loc_(1, 1) {
-    std::ifstream input; input.open(filename);
-    for (std::string line; std::getline(input, line);)
-      lines_.push_back(line);
-    input.close();
-  }
-
+  // Maps the given file into memory, falling back to reading it into an owned
+  // buffer when it can't be mapped (e.g. pipes).
+  stream(const char *filename);
+  // Streams over an owned copy of the given text.
+  stream(const char *filename, std::string text);
+
+  // A place in the source, as a byte offset from its start. Offsets are 64
+  // bits wide, so sources streamed in can be longer than 4GB. Parsing only
+  // ever needs to copy and compare them; see get_position() for lines and
+  // columns.
   class location {
   public:
-    location() { }
-    location(unsigned col, unsigned line) : col_(col), line_(line) { }
+    location() : offset_(0) { }
+    explicit location(uint64_t offset) : offset_(offset) { }
 
-    unsigned get_col()  const { return col_;  }
-    unsigned get_line() const { return line_; }
+    uint64_t get_offset() const { return offset_; }
 
-    bool operator<(const location &r) const {
-      return get_line() < r.get_line() || get_col() < r.get_col();
-    }
+    bool operator<(const location &r)  const { return offset_ < r.offset_;  }
+    bool operator>(const location &r)  const { return offset_ > r.offset_;  }
+    bool operator==(const location &r) const { return offset_ == r.offset_; }
+    bool operator!=(const location &r) const { return offset_ != r.offset_; }
 
-    bool operator>(const location &r) const {
-      return get_line() > r.get_line() || get_col() > r.get_col();
-    }
+  private:
+    uint64_t offset_;
+  };
 
-    bool operator==(const location &r) const {
-      return get_line() == r.get_line() && get_col()  == r.get_col();
-    }
+  // The line and column of a location, both counting from one. Columns count
+  // bytes.
+  class position {
+  public:
+    position(uint64_t line, uint64_t col) : line_(line), col_(col) { }
 
-    bool operator!=(const location &r) const {
-      return !(*this == r);
-    }
+    uint64_t get_line() const { return line_; }
+    uint64_t get_col()  const { return col_;  }
+
+    // Returns the position of the end of the text [begin, end), which
+    // starts at this position.
+    position advance(const char *begin, const char *end) const;
 
   private:
-    unsigned col_, line_;
+    uint64_t line_, col_;
   };
 
+  // Streams over an owned copy of the given text, which is a window onto a
+  // longer source starting at origin, at line and column origin_pos. Only
+  // the lines in the window can be got.
+  stream(const char *filename, std::string text, location origin,
+         position origin_pos);
+
   const char *get_filename() const { return filename_; }
 
-  location get_loc()       const { return loc_; }
-  void     set_loc(location loc) { loc_ = loc;  }
+  // Where the text the stream is over starts in the whole source.
+  location get_origin() const { return origin_; }
 
-  std::string get_line(unsigned line) const { return lines_.at(line - 1); }
+  // The whole text the stream is over, wherever the cursor is.
+  std::string_view get_text() const {
+    return std::string_view(begin_, limit_ - begin_);
+  }
 
-  bool is_valid() { return lines_.empty(); }
+  location get_loc() const {
+    return location(origin_.get_offset() + (cur_ - begin_));
+  }
 
-  char next();
-  char peek() const;
+  void set_loc(location loc) {
+    cur_ = begin_ + (loc.get_offset() - origin_.get_offset());
+  }
+
+  // Returns the line and column of loc. The first call indexes where every
+  // line of the text starts, which later calls, on this stream or any copy
+  // or slice of it, look loc up in. Only diagnostics need positions, so
+  // parsing doesn't pay for them.
+  position get_position(location loc) const;
+
+  // Returns where the line holding loc starts, or where the stream's text
+  // does if that is later.
+  location get_line_begin(location loc) const;
+  // Returns the line holding loc, from get_line_begin(loc) on.
+  std::string get_line(location loc) const;
+
+  // Returns a copy of the stream that starts at begin and stops at the given
+  // offset, which must not be past the end of this stream.
+  stream slice(location begin, uint64_t end) const;
+
+  // Whether the stream stops short of the end of its source, i.e. whether it
+  // is a slice of a longer stream.
+  bool is_truncated() const { return end_ != limit_; }
+
+  size_t get_size() const { return limit_ - begin_; }
+
+  bool is_valid() { return buf_->get_size() == 0; }
+
+  char next() {
+    char c = peek();
+    if (c)
+      ++cur_;
+    return c;
+  }
+
+  char peek() const { return cur_ != end_ ? *cur_ : '\0'; }
+
+  // The source text at the cursor. Views into the stream's buffer stay valid
+  // for as long as any copy of the stream is around.
+  const char *get_ptr() const { return cur_; }
+  const char *get_end() const { return end_; }
+
+  // Moves the cursor forward to p, which must lie between the cursor and the
+  // end of the stream.
+  void skip_to(const char *p) { cur_ = p; }
 
 private:
-  const char              *filename_;
-  std::vector<std::string> lines_;
-  location                 loc_;
-};
+  // The contiguous, read-only source text shared by all copies of a stream.
+  class buffer {
+  public:
+    buffer() : data_(nullptr), size_(0), mapped_(false) { }
+    ~buffer();
+
+    bool map(const char *filename);
+    void own(std::string text);
+
+    const char *get_data() const { return data_; }
+    size_t      get_size() const { return size_; }
 
+    // The offsets of the first character after every line break, indexed
+    // the first time they're asked for.
+    const std::vector<size_t> &get_line_starts() const;
+
+  private:
+    buffer(const buffer&) = delete;
+    buffer& operator=(const buffer&) = delete;
+
+    const char *data_;
+    size_t      size_;
+    bool        mapped_;
+    std::string owned_;
+
+    mutable std::once_flag       lines_once_;
+    mutable std::vector<size_t>  line_starts_;
+  };
+
+  void init();
+
+  const char                   *filename_;
+  std::shared_ptr<const buffer> buf_;
+  const char                   *begin_, *end_, *limit_, *cur_;
+  location                      origin_;
+  position                      origin_pos_;
+};
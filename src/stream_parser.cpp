@@ -0,0 +1,111 @@
+#include "stream_parser.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace {
+
+// Returns where the last definition that ends in [begin, end) most likely
+// ends, like parser::find_def_end() but from the back, or nullptr if none
+// does. The spaces after the ';' have to end before end, since more of them
+// might follow.
+const char *find_last_def_end(const char *begin, const char *end) {
+  const char *limit = end;
+  while (const char *p = static_cast<const char*>(
+           memrchr(begin, ';', limit - begin))) {
+    if (p != begin && scanner::is_space(p[-1]) && p + 1 != end &&
+        scanner::is_space(p[1])) {
+      const char *e = scanner::is_space.scan(p + 1, end);
+      if (e != end)
+        return e;
+    }
+    limit = p;
+  }
+  return nullptr;
+}
+
+} // end anonymous namespace
+
+void stream_parser::fill(size_t size) {
+  while (!eof_ && window_.size() < size) {
+    size_t have = window_.size();
+    window_.resize(size);
+    ssize_t n = read(fd_, &window_[have], size - have);
+    if (n < 0 && errno == EINTR)
+      n = 0;
+    else if (n <= 0)
+      eof_ = true;
+    failed_ = failed_ || n < 0;
+    window_.resize(have + std::max<ssize_t>(n, 0));
+  }
+}
+
+void stream_parser::drop_before(stream::location loc) {
+  // Offsets into the window. The line break before the line is only looked
+  // for as far back as would be kept anyway.
+  const char *text = window_.data();
+  size_t at = loc.get_offset() - origin_.get_offset();
+  size_t keep = at - std::min(at, chunk_size_);
+  if (const void *nl = memrchr(text + keep, '\n', at - keep))
+    keep = static_cast<const char*>(nl) + 1 - text;
+  origin_pos_ = origin_pos_.advance(text, text + keep);
+  window_.erase(0, keep);
+  origin_ = stream::location(origin_.get_offset() + keep);
+}
+
+bool stream_parser::parse(const std::function<void(module&)> &fn) {
+  bool ok = true;
+  stream::location begin = origin_;
+  // How much to parse past begin; doubled each time a window has to be
+  // parsed again.
+  size_t want = chunk_size_;
+  for (;;) {
+    size_t from = begin.get_offset() - origin_.get_offset();
+    fill(from + want);
+    if (failed_)
+      return false;
+
+    const char *text = window_.data();
+    const char *end = eof_ ? text + window_.size() :
+                      find_last_def_end(text + from, text + window_.size());
+    if (!end) {
+      want *= 2;
+      continue;
+    }
+
+    stream s(filename_, window_, origin_, origin_pos_);
+    uint64_t end_offset = origin_.get_offset() + (end - text);
+    if (eof_)
+      s.set_loc(begin);
+    parser prs(eof_ ? s : s.slice(begin, end_offset));
+    std::ostringstream os;
+    prs.set_diagnostics(os);
+    prs.set_stats(stats_);
+    prs.set_packrat(packrat_);
+    module mod;
+    // Only the last window runs to the real end of the input, so it's the
+    // only one that always parses the way a whole-file parse would.
+    if (!prs.parse_piece(mod) && !eof_) {
+      want *= 2;
+      continue;
+    }
+
+    *diag_ << os.str();
+    ok = ok && mod.is_valid();
+    fn(mod);
+
+    // Parsing stops early at a NUL, and then so does the whole parse.
+    stream::location loc = prs.get_stream().get_loc();
+    if (eof_ || loc.get_offset() != end_offset)
+      return ok;
+    begin = loc;
+    drop_before(loc);
+    want = chunk_size_;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "module.h"
+#include "stats.h"
+#include "stream.h"
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <string>
+
+// Parses a source read from a file descriptor a window at a time, so a pipe
+// or a file of any size is parsed in bounded memory. Each window is cut off
+// where a definition most likely ends and parsed like one chunk of a parallel
+// parse; if error recovery ran into the cut, more is read and the window is
+// parsed again. Once a window's definitions are done with, its text is
+// dropped, except for the current line, which diagnostics may still show.
+class stream_parser {
+public:
+  stream_parser(const char *filename, int fd)
+    : filename_(filename), fd_(fd), diag_(&std::cerr),
+      chunk_size_(1 << 20), stats_(nullptr), packrat_(false),
+      origin_pos_(1, 1), eof_(false), failed_(false) {
+  }
+
+  // Sets where diagnostics are printed, std::cerr by default.
+  void set_diagnostics(std::ostream &os) { diag_ = &os; }
+  // Counts what parsing every window does into stats, if it's set.
+  void set_stats(parse_stats *stats) { stats_ = stats; }
+  // Parses every window in packrat mode; see parser::set_packrat().
+  void set_packrat(bool packrat) { packrat_ = packrat; }
+  // How much is read at a time, and so roughly how much is held onto.
+  void set_chunk_size(size_t n) { chunk_size_ = n; }
+
+  // Parses the whole input, handing each window's definitions to fn before
+  // dropping them. Diagnostics are printed as each window is done. Returns
+  // whether the input was read and parsed without errors.
+  bool parse(const std::function<void(module&)> &fn);
+
+  // Whether reading the input failed.
+  bool has_failed() const { return failed_; }
+
+private:
+  stream_parser(const stream_parser&) = delete;
+  stream_parser& operator=(const stream_parser&) = delete;
+
+  // Reads until the window holds at least size bytes or the input ends.
+  void fill(size_t size);
+
+  // Drops the window's text before the line holding loc, or all but the last
+  // chunk's worth of it if the line is longer than that.
+  void drop_before(stream::location loc);
+
+  const char   *filename_;
+  int           fd_;
+  std::ostream *diag_;
+  size_t        chunk_size_;
+  parse_stats  *stats_;
+  bool          packrat_;
+  // The text read but not yet dropped, and where it starts in the input.
+  std::string      window_;
+  stream::location origin_;
+  stream::position origin_pos_;
+  bool             eof_, failed_;
+};
@@ -0,0 +1,23 @@
+#include "symbol.h"
+
+#include <cstring>
+
+symbol symbol_table::intern(std::string_view name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end())
+    return symbol(it->second);
+
+  char *str = arena_.make_array<char>(name.size());
+  std::memcpy(str, name.data(), name.size());
+  std::string_view copy(str, name.size());
+
+  uint32_t id = names_.size();
+  names_.push_back(copy);
+  ids_.emplace(copy, id);
+  return symbol(id);
+}
+
+symbol symbol_table::lookup(std::string_view name) const {
+  auto it = ids_.find(name);
+  return it != ids_.end() ? symbol(it->second) : symbol();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "arena.h"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// An interned name. Symbols from the same table are equal exactly when their
+// names are, so comparing names is an integer compare.
+class symbol {
+public:
+  symbol() : id_(UINT32_MAX) { }
+  explicit symbol(uint32_t id) : id_(id) { }
+
+  uint32_t get_id() const { return id_; }
+
+  bool is_valid() const { return id_ != UINT32_MAX; }
+
+  bool operator==(symbol r) const { return id_ == r.id_; }
+  bool operator!=(symbol r) const { return id_ != r.id_; }
+  bool operator<(symbol r)  const { return id_ <  r.id_; }
+
+private:
+  uint32_t id_;
+};
+
+// Maps names to symbols. Each distinct name is copied once into the table's
+// own arena; looking up a name that's already there allocates nothing.
+class symbol_table {
+public:
+  symbol_table() { }
+  symbol_table(symbol_table &&other) = default;
+
+  symbol_table& operator=(symbol_table &&other) = default;
+
+  symbol intern(std::string_view name);
+
+  // Returns the symbol for the given name, or an invalid symbol if the name
+  // was never interned.
+  symbol lookup(std::string_view name) const;
+
+  std::string_view get_name(symbol sym) const { return names_[sym.get_id()]; }
+
+  size_t size() const { return names_.size(); }
+
+private:
+  symbol_table(const symbol_table&) = delete;
+  symbol_table& operator=(const symbol_table&) = delete;
+
+  arena                                          arena_;
+  std::unordered_map<std::string_view, uint32_t> ids_;
+  std::vector<std::string_view>                  names_;
+};
@@ -0,0 +1,75 @@
+#include "thread_pool.h"
+
+// Set while a thread is running a loop body, so nested loops run serially
+// instead of waiting on the pool they're running on.
+static thread_local bool in_loop = false;
+
+thread_pool::thread_pool(unsigned threads)
+  : fn_(nullptr), n_(0), next_(0), busy_(0), generation_(0), stop_(false) {
+  if (!threads)
+    threads = std::thread::hardware_concurrency();
+  for (unsigned i = 1; i < threads; ++i)
+    workers_.emplace_back([this] { work(); });
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto it = workers_.begin(), e = workers_.end(); it != e; ++it)
+    it->join();
+}
+
+void thread_pool::parallel_for(size_t n,
+                               const std::function<void(size_t)> &fn) {
+  if (in_loop || workers_.empty() || n < 2) {
+    for (size_t i = 0; i != n; ++i)
+      fn(i);
+    return;
+  }
+
+  std::lock_guard<std::mutex> loop_lock(loop_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fn_ = &fn;
+    n_ = n;
+    next_ = 0;
+    busy_ = workers_.size();
+    ++generation_;
+  }
+  start_.notify_all();
+
+  run_tasks();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return busy_ == 0; });
+  fn_ = nullptr;
+}
+
+void thread_pool::run_tasks() {
+  in_loop = true;
+  for (size_t i; (i = next_.fetch_add(1, std::memory_order_relaxed)) < n_;)
+    (*fn_)(i);
+  in_loop = false;
+}
+
+void thread_pool::work() {
+  unsigned seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+    }
+
+    run_tasks();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--busy_ == 0)
+      done_.notify_one();
+  }
+}
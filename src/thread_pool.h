@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for data-parallel loops.
+class thread_pool {
+public:
+  // Starts a pool that runs loops on the given number of threads, counting
+  // the caller. Zero picks one thread per hardware thread.
+  explicit thread_pool(unsigned threads = 0);
+  ~thread_pool();
+
+  unsigned size() const { return workers_.size() + 1; }
+
+  // Calls fn(i) for every i in [0, n), spread over the pool's threads and the
+  // calling thread, and returns once every call has finished. A loop started
+  // from inside another loop's body runs serially on the calling thread.
+  void parallel_for(size_t n, const std::function<void(size_t)> &fn);
+
+private:
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  void work();
+  void run_tasks();
+
+  std::vector<std::thread>           workers_;
+  std::mutex                         loop_mutex_, mutex_;
+  std::condition_variable            start_, done_;
+  const std::function<void(size_t)> *fn_;
+  size_t                             n_;
+  std::atomic<size_t>                next_;
+  unsigned                           busy_, generation_;
+  bool                               stop_;
+};
@@ -0,0 +1,134 @@
+#include "vm.h"
+
+#include <cstring>
+
+vm::vm(const program &prog, size_t stack_size, size_t locals_size,
+       size_t frames_size)
+  : prog_(prog), stack_(stack_size), locals_(locals_size),
+    frames_(frames_size), depth_(0), dispatches_(0) {
+}
+
+vm::status vm::run(symbol word) {
+  program::word w = prog_.get_word(word);
+  if (w.entry == UINT32_MAX)
+    return status::NO_WORD;
+  if (depth_ < w.inputs)
+    return status::STACK_UNDERFLOW;
+
+  const uint32_t growth = prog_.get_max_growth();
+  const uint8_t *code = prog_.get_code(), *ip = code + w.entry;
+  int64_t *sp = stack_.data() + depth_;
+  int64_t *const stack_end = stack_.data() + stack_.size();
+  int64_t *fp = locals_.data(), *lp = fp;
+  int64_t *const locals_end = locals_.data() + locals_.size();
+  frame *rp = frames_.data();
+  frame *const frames_end = frames_.data() + frames_.size();
+  uint64_t n = 0;
+  status st = status::OK;
+
+  if (static_cast<size_t>(stack_end - sp) < growth)
+    return status::STACK_OVERFLOW;
+  // The outermost word returns to the HALT at the start of the code.
+  *rp++ = frame{code, fp};
+
+  // One label per opcode, in the order of program::op.
+  static void *const labels[] = {
+    &&HALT, &&DUP, &&DROP, &&SWAP, &&ROT, &&OVER, &&NIP, &&TUCK, &&NROT,
+    &&SHUFFLE, &&CALL, &&LOCAL, &&ENTER, &&RET, &&LEAVE
+  };
+#define DISPATCH() do { ++n; goto *labels[*ip++]; } while (0)
+
+  DISPATCH();
+
+DUP:
+  sp[0] = sp[-1];
+  ++sp;
+  DISPATCH();
+DROP:
+  --sp;
+  DISPATCH();
+SWAP: {
+  int64_t t = sp[-1];
+  sp[-1] = sp[-2];
+  sp[-2] = t;
+  DISPATCH();
+}
+ROT: {
+  int64_t t = sp[-3];
+  sp[-3] = sp[-2];
+  sp[-2] = sp[-1];
+  sp[-1] = t;
+  DISPATCH();
+}
+OVER:
+  sp[0] = sp[-2];
+  ++sp;
+  DISPATCH();
+NIP:
+  sp[-2] = sp[-1];
+  --sp;
+  DISPATCH();
+TUCK:
+  sp[0] = sp[-1];
+  sp[-1] = sp[-2];
+  sp[-2] = sp[0];
+  ++sp;
+  DISPATCH();
+NROT: {
+  int64_t t = sp[-1];
+  sp[-1] = sp[-2];
+  sp[-2] = sp[-3];
+  sp[-3] = t;
+  DISPATCH();
+}
+SHUFFLE: {
+  uint8_t inputs = ip[0], outputs = ip[1];
+  int64_t values[UINT8_MAX];
+  sp -= inputs;
+  std::memcpy(values, sp, inputs * sizeof(int64_t));
+  for (uint8_t i = 0; i != outputs; ++i)
+    sp[i] = values[ip[2 + i]];
+  sp += outputs;
+  ip += 2 + outputs;
+  DISPATCH();
+}
+CALL: {
+  uint32_t target;
+  std::memcpy(&target, ip, sizeof(target));
+  if (rp == frames_end || static_cast<size_t>(stack_end - sp) < growth) {
+    st = status::STACK_OVERFLOW;
+    goto HALT;
+  }
+  *rp++ = frame{ip + sizeof(target), fp};
+  ip = code + target;
+  DISPATCH();
+}
+LOCAL:
+  *sp++ = fp[*ip++];
+  DISPATCH();
+ENTER: {
+  uint8_t args = *ip++;
+  if (locals_end - lp < args) {
+    st = status::STACK_OVERFLOW;
+    goto HALT;
+  }
+  sp -= args;
+  std::memcpy(lp, sp, args * sizeof(int64_t));
+  fp = lp;
+  lp += args;
+  DISPATCH();
+}
+LEAVE:
+  lp = fp;
+  // Fall through.
+RET:
+  --rp;
+  ip = rp->ip;
+  fp = rp->fp;
+  DISPATCH();
+HALT:
+#undef DISPATCH
+  depth_ = sp - stack_.data();
+  dispatches_ += n;
+  return st;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "bytecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Runs compiled programs. The operand, argument and return stacks are each
+// allocated up front in one piece and never grow; running a word checks up
+// front that they can't overflow before its next call.
+class vm {
+public:
+  // The stack sizes are in entries.
+  explicit vm(const program &prog, size_t stack_size = 1 << 16,
+              size_t locals_size = 1 << 16, size_t frames_size = 1 << 14);
+
+  void    push(int64_t v) { stack_[depth_++] = v; }
+  int64_t pop()           { return stack_[--depth_]; }
+
+  size_t  get_depth()       const { return depth_;     }
+  int64_t get(size_t i)     const { return stack_[i];  }
+  void    clear()                 { depth_ = 0;        }
+
+  // The number of instructions dispatched so far.
+  uint64_t get_dispatches() const { return dispatches_; }
+
+  enum class status { OK, NO_WORD, STACK_UNDERFLOW, STACK_OVERFLOW };
+
+  // Runs the given word on the values on the stack. If the word can't be
+  // started the stack is left alone; otherwise it's only valid after OK.
+  status run(symbol word);
+
+private:
+  vm(const vm&) = delete;
+  vm& operator=(const vm&) = delete;
+
+  // A return address and the frame to go back to.
+  struct frame {
+    const uint8_t *ip;
+    int64_t       *fp;
+  };
+
+  const program       &prog_;
+  std::vector<int64_t> stack_, locals_;
+  std::vector<frame>   frames_;
+  size_t               depth_;
+  uint64_t             dispatches_;
+};